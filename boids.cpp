@@ -5,49 +5,388 @@
 //
 
 #include "tigr.h"
+#include "simulation.h"
 #include <algorithm>
 #include <iostream>
 #include <math.h>
 #include <string>
+#include <cstring>
 #include <vector>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
 #include <random>
+#include <csignal>
+#include <cerrno>
+#include <memory>
+#include <deque>
+
+// Snapshots, replays, shared state and streaming map files and open sockets through
+// POSIX calls; on Windows they report that they aren't supported instead
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
 
 // #define NS_PRIVATE_IMPLEMENTATION
 // #define CA_PRIVATE_IMPLEMENTATION
 // #define MTL_PRIVATE_IMPLEMENTATION
 // #include "Metal.hpp"
 
-// Boid structure
-struct Boid {
-    float x, y;
-    float dx, dy;
-    std::vector<std::pair<float, float>> history;
-    TPixel color;
+// Time spent drawing each part of a frame, in milliseconds (the tiled renderer only
+// fills in bin, tiles and ui, and heatmap is only set for very large flocks)
+struct RenderTimes {
+    double clear = 0;
+    double trails = 0;
+    double boids = 0;
+    double predators = 0;
+    double ui = 0;
+    double bin = 0;
+    double tiles = 0;
+    double heatmap = 0;
+};
+
+// Pixel rectangle (right and bottom edges exclusive)
+struct TileRect {
+    int x0, y0, x1, y1;
+};
+
+// Range of screen tiles an item covers (empty when x0 > x1)
+struct TileRange {
+    uint16_t x0, y0, x1, y1;
+};
+
+// Rotated rectangle pre-rasterized as one span per row, centered on the origin
+struct Sprite {
+    int top = 0;                 // Row of the first span, relative to the center
+    std::vector<int16_t> x0, x1; // Inclusive span of each row
+};
+
+// Sprite atlas structure (boid and predator shapes pre-rasterized at evenly spaced
+// headings, rebuilt when SIZE or the zoom changes; colors are applied while drawing, so moving
+// the color slider costs nothing)
+struct SpriteAtlas {
+    float size = -1.0f;
+    std::vector<Sprite> boids, predators;
+};
+
+// Cached UI structure (the slider and instruction panels drawn into transparent bitmaps,
+// so text is only rendered when a slider moves)
+struct UiOverlay {
+    Tigr* sliders = nullptr;
+    Tigr* instructions = nullptr;
+    std::vector<float> values; // Slider values the slider panel shows
+};
+
+// Density heatmap structure (boids splatted into cells of a few pixels, with their
+// velocities summed so cells can be colored by speed; boids are sorted into bands of
+// cell rows first, so each band is splatted by one thread)
+struct Heatmap {
+    int w = 0, h = 0;
+    std::vector<float> density, sumDx, sumDy;
+    std::vector<uint32_t> cellOf;
+    std::vector<uint32_t> bandStart, cursor, order;
+};
+
+// Tile renderer structure (trail runs, boid bodies and predators binned into square
+// screen tiles in draw order, so every tile can be rasterized on its own thread and
+// still blend its pixels in the order a single thread would)
+struct TileRenderer {
+    int tileSize = 64;
+    int tilesX = 0, tilesY = 0;
+    std::vector<uint32_t> runStart;         // First trail run of each visible boid, numVisible + 1 offsets
+    std::vector<uint32_t> runBoid;          // Boid and first trail point of each trail run
+    std::vector<uint32_t> runFirst;
+    std::vector<uint8_t> heading;           // Sprite heading of each visible boid, then each predator
+    std::vector<TileRange> ranges;          // Trail runs, then visible boids, then predators
+    std::vector<uint32_t> tileStart;        // tilesX * tilesY + 1 offsets into items
+    std::vector<uint32_t> cursor;
+    std::vector<uint32_t> items;
+};
+
+// Camera structure (the world point shown at the top left corner of the window, and
+// how many screen pixels one world unit covers)
+struct Camera {
+    float x = 0.0f, y = 0.0f;
+    float zoom = 1.0f;
+};
+
+// Snapshot sections, one array each, in file order
+enum SnapshotSection {
+    SNAPSHOT_BOID_ID,
+    SNAPSHOT_BOID_X,
+    SNAPSHOT_BOID_Y,
+    SNAPSHOT_BOID_DX,
+    SNAPSHOT_BOID_DY,
+    SNAPSHOT_TRAIL_START,   // numBoids + 1 offsets into the trail points
+    SNAPSHOT_TRAIL_X,
+    SNAPSHOT_TRAIL_Y,
+    SNAPSHOT_PREDATOR_ID,
+    SNAPSHOT_PREDATOR_X,
+    SNAPSHOT_PREDATOR_Y,
+    SNAPSHOT_PREDATOR_DX,
+    SNAPSHOT_PREDATOR_DY,
+    SNAPSHOT_FIXED,         // 16.16 boids then predators, only when the run is in fixed-point mode
+    SNAPSHOT_SECTIONS
+};
+
+// Snapshot header structure (everything needed to resume a run besides the arrays,
+// and where each array starts; arrays are 64-byte aligned so they can be used in place)
+struct SnapshotHeader {
+    uint32_t magic, version;
+    uint64_t fileSize;
+    uint64_t seed;
+    uint32_t step, nextBoidId, nextPredatorId;
+    uint32_t mode, backend;
+    int32_t worldWidth, worldHeight;
+    float windTime;
+    float centering, avoid, matching, speedLimit, trailLength, hue, margin, turn, size;
+    uint64_t numBoids, numPredators, numTrailPoints, numFixed;
+    uint64_t offsets[SNAPSHOT_SECTIONS];
+};
+
+// Mapped snapshot structure (a read-only view of a snapshot file)
+struct Snapshot {
+    const SnapshotHeader* header = nullptr;
+    void* data = nullptr;
+    size_t size = 0;
+};
+
+// Background checkpoint structure (a spare buffer the state is copied into between steps,
+// and a thread that writes it out while stepping goes on)
+struct Checkpointer {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t capacity = 0;
+    size_t size = 0;         // Bytes of the snapshot in the buffer
+    uint32_t step = 0;       // Step it was taken at
+    double copyMs = 0;
+    bool pending = false;    // Buffer holds a snapshot that is not written yet
+    bool quit = false;
+    int skipped = 0;         // Checkpoints dropped because the last one was still being written
+};
+
+// Recorded frame structure (one step of the flock as structure of arrays; predators are
+// few, so they are kept as x, y, dx, dy per predator)
+struct RecordedFrame {
+    uint32_t step = 0;
+    std::vector<uint32_t> ids;
+    std::vector<float> x, y, dx, dy;
+    std::vector<float> predators;
+};
+
+// Frame codec structure (the quantized values of the last frame coded, which the next
+// frame is coded against; encoder and decoder keep the same state)
+struct FrameCodec {
+    int32_t positionScale = 16, velocityScale = 64; // Steps per pixel, and per pixel per step
+    bool valid = false;
+    uint32_t step = 0;
+    uint32_t sinceKeyframe = 0;
+    std::vector<uint32_t> ids;
+    std::vector<int32_t> x, y, dx, dy;
+    std::vector<int32_t> residual;
+};
+
+// Header of a recording file, followed by the frames back to back
+struct RecordingHeader {
+    uint32_t magic, version;
+    int32_t worldWidth, worldHeight;
+    int32_t positionScale, velocityScale;
+    uint32_t keyframeInterval, reserved;
+    uint64_t seed;
+};
+
+// Header of one coded frame, followed by its payload
+struct FrameHeader {
+    uint32_t step;
+    uint32_t numBoids, numPredators;
+    uint32_t keyframe;
+    uint64_t payloadBytes;
+};
+
+// Trajectory recorder structure (frames captured between steps go into a ring of raw
+// frames; a background thread encodes them and appends them to the recording)
+struct TrajectoryRecorder {
+    FILE* file = nullptr;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<RecordedFrame> ring;
+    uint64_t head = 0, tail = 0; // Frames captured, and frames encoded
+    bool quit = false;
+    FrameCodec codec;
+    std::vector<uint8_t> encoded;
+    uint64_t bytes = 0, frames = 0, boidSteps = 0, dropped = 0;
+};
+
+// Replay player structure (a mapped recording, where each of its frames starts, and a
+// decoder thread filling a ring of frames ahead of the one on screen)
+struct ReplayPlayer {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    RecordingHeader header;
+    std::vector<uint64_t> frameOffsets;
+    std::vector<size_t> keyframes;   // Indices of the keyframes among the frames
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<RecordedFrame> ring;
+    std::vector<size_t> ringFrame;   // Index of the frame in each ring slot
+    uint64_t head = 0, tail = 0;     // Frames decoded, and frames taken
+    size_t nextFrame = 0;            // Next frame to decode
+    uint64_t generation = 0;         // Bumped by every seek, so frames decoded before it are dropped
+    bool quit = false;
+    FrameCodec codec;
+};
+
+// Rewind timeline structure (the recent run, encoded in memory the way a recording is:
+// every step for the newest part, then only the keyframes further back)
+struct TimelineFrame {
+    uint32_t step;
+    bool keyframe;
+    float windTime;
+    std::vector<uint8_t> data;
+};
+
+struct RewindTimeline {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::vector<RecordedFrame> ring;
+    std::vector<float> ringWindTime;
+    uint64_t head = 0, tail = 0;
+    bool quit = false;
+    FrameCodec codec;                 // Encoder state, continuing from the newest frame
+    std::vector<uint8_t> encoded;
+    std::deque<TimelineFrame> frames;
+    size_t thinned = 0;               // Frames at the front that have lost the steps between their keyframes
+    size_t stepBytes = 0, keyframeBytes = 0;  // Memory held by the every-step part, and by the thinned part
+    uint64_t dropped = 0;
+    bool rewound = false;             // Showing an earlier frame instead of the live flock
+    size_t shown = 0;
+    FrameCodec viewCodec;             // Decoder state for the frame shown
+    RecordedFrame view;
+};
+
+// Shared-memory state structures: a header, then a ring of slots, each holding one step's
+// arrays. A slot's sequence number is odd while the slot is being written.
+enum SharedArray {
+    SHARED_BOID_ID,
+    SHARED_BOID_X,
+    SHARED_BOID_Y,
+    SHARED_BOID_DX,
+    SHARED_BOID_DY,
+    SHARED_PREDATOR_X,
+    SHARED_PREDATOR_Y,
+    SHARED_PREDATOR_DX,
+    SHARED_PREDATOR_DY,
+    SHARED_ARRAYS
+};
+
+struct SharedStateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t boidCapacity;           // Boids and predators each slot has room for
+    uint32_t predatorCapacity;
+    std::atomic<uint32_t> closed;    // Set when the writer has moved to a bigger segment or exited
+    uint64_t segmentSize;
+    uint64_t slotsOffset;            // Where the first slot starts
+    uint64_t slotSize;
+    uint64_t arrayOffsets[SHARED_ARRAYS];  // Where each array starts within a slot
+    float worldWidth, worldHeight;
+    std::atomic<uint64_t> published; // Steps published; the newest is in slot (published - 1) % numSlots
+};
+
+struct SharedStateSlot {
+    std::atomic<uint64_t> sequence;
+    uint32_t step;
+    uint32_t numBoids;
+    uint32_t numPredators;
+};
+
+struct SharedStatePublisher {
+    std::string name;
+    uint8_t* base = nullptr;
+    SharedStateHeader* header = nullptr;
+};
+
+// Streaming server structures: each client gets the run as a recording, encoded against
+// what that client was last sent, and says how it wants to be slowed down when it falls
+// behind
+enum StreamPolicy {
+    STREAM_DROP_FRAMES,
+    STREAM_DOWNSAMPLE
+};
+
+struct StreamClient {
+    int fd = -1;
+    std::atomic<int> policy{STREAM_DROP_FRAMES};
+    std::string request;            // Partial line read from the client
+    std::vector<uint8_t> pending;   // Encoded bytes not yet sent
+    size_t sent = 0;                // How much of pending has been sent
+    bool closed = false;
+    FrameCodec codec;               // Encoder state for this client
+    uint32_t stride = 1;            // When downsampling, only boids whose id is a multiple of this
+    uint64_t frames = 0, dropped = 0;
+};
+
+struct StreamServer {
+    int listenFd = -1;
+    int wakePipe[2] = {-1, -1};     // Written to when there is something to send
+    std::thread network, encoder;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<RecordedFrame> ring;
+    uint64_t head = 0, tail = 0;
+    bool quit = false;
+    std::chrono::steady_clock::time_point stopBy;  // When to stop waiting for clients to catch up
+    std::vector<std::shared_ptr<StreamClient>> clients;
+    RecordedFrame subset;
+    std::vector<uint8_t> encoded;
+    uint64_t dropped = 0, served = 0;
 };
 
-// Predator structure
-struct Predator {
-    float x, y;
-    float dx, dy;
-    TPixel color;
-    bool show;
+// Renderers
+enum Renderer {
+    RENDER_TIGR, // Every shape drawn with tigr calls on the main thread
+    RENDER_TILED // Shapes binned into screen tiles, and tiles rasterized on the worker pool
 };
 
 // Constants
-int SCREEN_WIDTH = 1280;
-int SCREEN_HEIGHT = 720;
+bool WORLD_FOLLOWS_WINDOW = true; // World resizes with the window unless --world fixes it
+const int WINDOW_WIDTH = 1280;
+const int WINDOW_HEIGHT = 720;
+const float CAMERA_PAN_SPEED = 600.0f; // Screen pixels per second
+const float CAMERA_ZOOM_SPEED = 2.0f; // Zoom factor per second
+const float CAMERA_MIN_ZOOM = 0.05f;
+const float CAMERA_MAX_ZOOM = 16.0f;
 int NUM_BOIDS = 100;
-const float VISUAL_RANGE = 75.0f;
-const float PREDATOR_FEAR_FACTOR = 0.15f; // Factor for boids to avoid predator
-
-// Adjustable parameters (controlled by sliders)
-float CENTERING_FACTOR = 0.005f;
-float AVOID_FACTOR = 0.05f;
-float MATCHING_FACTOR = 0.05f;
-float MARGIN = 120.0f;
-float TURN_FACTOR = 0.3f;
-float SPEED_LIMIT = 7.5f;
-float TRAIL_LENGTH = 50.0f;
+int NUM_THREADS = std::max(1u, std::thread::hardware_concurrency());
+Renderer RENDERER = RENDER_TILED;
+const int TRAIL_RUN_LENGTH = 8; // Trail segments binned together by the tiled renderer
+const int SPRITE_HEADINGS = 64; // Headings pre-rasterized in the sprite atlas
+int HEATMAP_BOIDS = 200000; // Flock size at which drawing is half per-boid and half heatmap
+const float HEATMAP_DENSITY = 0.2f; // Boids per pixel at which the same happens
+const int HEATMAP_CELL = 2; // Heatmap cell size in pixels
+const int HEATMAP_BAND = 8; // Cell rows splatted by one task
+
+// Adjustable parameters (controlled by sliders, next to the world's own in WorldParams)
 float HUE = 0.5f;
 float SIZE = 3.0f;
 
@@ -59,24 +398,133 @@ struct Slider {
 };
 
 // Function prototypes
-void initBoids(std::vector<Boid>& boids);
-void updateBoid(Boid& boid, const std::vector<Boid>& boids, const std::vector<Predator>& predators);
 void drawBoid(Tigr* screen, const Boid& boid);
 void drawSlider(Tigr* screen, Slider& slider);
+std::vector<Slider> createSliders();
+void updateUiOverlay(UiOverlay& overlay, std::vector<Slider>& sliders);
+void drawUi(Tigr* screen, std::vector<Slider>& sliders);
+void renderFrame(Tigr* screen, const Flock& boids, const Flock& predators, std::vector<Slider>& sliders,
+                 RenderTimes& times);
 void updateSlider(Slider& slider, int mouseX, int mouseY, bool mouseDown);
-void addBoid(std::vector<Boid>& boids, float x, float y);
-void handleHotkeys(Tigr* screen, std::vector<Boid>& boids, std::vector<Predator>& predators);
-void resetSimulation(std::vector<Boid>& boids, std::vector<Predator>& predators);
-void nudgeBoids(Tigr* screen, std::vector<Boid>& boids, float dx, float dy);
+void handleHotkeys(Tigr* screen, Flock& boids, Flock& predators);
+void resetSimulation(Flock& boids, Flock& predators);
+void drawWindParticles(Tigr* screen);
 TPixel hsvToRgb(float h, float s, float v);
-void addPredator(std::vector<Predator>& predators, float x, float y);
-void updatePredator(Predator& predator, const std::vector<Boid>& boids, const std::vector<Predator>& predators);
+void updateColors();
 void drawPredator(Tigr* screen, const Predator& predator);
+bool loadObstacles(const char* fileName, ObstacleField& field);
+void drawObstacles(Tigr* screen);
+bool validateFixedMode(int steps);
+bool runSelfTest();
+void runWorlds(int numWorlds, int steps, int numPredators);
+bool runScalingBenchmark(const std::string& outputPrefix);
+bool runRuleBenchmarks();
+bool runRenderBenchmark(const std::string& outputPrefix, const std::vector<std::pair<int, int>>& resolutions,
+                        const std::vector<int>& boidCounts, int numPredators, const Snapshot* snapshot);
+bool recordGoldenTrajectories(const std::string& fileName);
+bool checkGoldenTrajectories(const std::string& fileName);
+void drawTrail(Tigr* screen, const Flock& boids, size_t i);
+void blendPixel(TPixel& dst, TPixel src);
+void updateSprites(SpriteAtlas& atlas);
+int spriteHeading(float dx, float dy);
+void blitSprite(Tigr* screen, const Sprite& sprite, float x, float y, TPixel color, const TileRect& clip);
+void binTiles(TileRenderer& tiles, int width, int height, const Flock& boids,
+              const std::vector<uint32_t>& visible, const Flock& predators);
+void renderTiled(Tigr* screen, const Flock& boids, const std::vector<uint32_t>& visible,
+                 const Flock& predators, TileRenderer& tiles, RenderTimes& times);
+float heatmapWeight(size_t numBoids, int width, int height);
+void renderHeatmap(Tigr* screen, const Flock& boids, const std::vector<uint32_t>& visible, Heatmap& map,
+                   float weight);
+bool writeSnapshot(const std::string& fileName, const Flock& boids, const Flock& predators);
+bool mapSnapshot(const std::string& fileName, Snapshot& snapshot);
+void unmapSnapshot(Snapshot& snapshot);
+void restoreSnapshot(const Snapshot& snapshot, Flock& boids, Flock& predators);
+bool checkpoint(Checkpointer& checkpointer, const Flock& boids, const Flock& predators);
+void autoCheckpoint(Checkpointer& checkpointer, const Flock& boids, const Flock& predators);
+void stopCheckpointer(Checkpointer& checkpointer);
+void captureFrame(RecordedFrame& frame, const Flock& boids, const Flock& predators);
+void encodeFrame(FrameCodec& codec, const RecordedFrame& frame, bool keyframe, std::vector<uint8_t>& out);
+bool decodeFrame(FrameCodec& codec, const uint8_t* data, size_t size, RecordedFrame& frame);
+bool startRecorder(TrajectoryRecorder& recorder, const std::string& fileName);
+void recordFrame(TrajectoryRecorder& recorder, const Flock& boids, const Flock& predators);
+void stopRecorder(TrajectoryRecorder& recorder);
+bool openReplay(ReplayPlayer& player, const std::string& fileName);
+void closeReplay(ReplayPlayer& player);
+size_t seekReplay(ReplayPlayer& player, size_t frame);
+bool takeReplayFrame(ReplayPlayer& player, RecordedFrame& frame, size_t& index);
+int runReplay(const std::string& fileName);
+void recordTimeline(RewindTimeline& timeline, const Flock& boids, const Flock& predators);
+void stopTimeline(RewindTimeline& timeline);
+void clearTimeline(RewindTimeline& timeline);
+void updateRewind(Tigr* screen, RewindTimeline& timeline, bool& animationRunning, Flock& boids, Flock& predators);
+void resumeFromTimeline(RewindTimeline& timeline);
+bool publishState(SharedStatePublisher& publisher, const Flock& boids, const Flock& predators);
+void closeSharedState(SharedStatePublisher& publisher);
+int watchSharedState(const std::string& name);
+bool startStreamServer(StreamServer& server, int port);
+void streamFrame(StreamServer& server, const Flock& boids, const Flock& predators);
+void stopStreamServer(StreamServer& server);
+float toScreenX(float x);
+float toScreenY(float y);
+void updateCamera(Tigr* screen, float dt);
+void fitCamera(int width, int height);
+void findVisibleBoids(const Flock& boids, int width, int height, std::vector<uint32_t>& visible);
+void compositeObstacles(Tigr* screen, const Tigr* layer, const TileRect& clip);
+
+// The simulated world, and the threads that step and draw it
+World world;
+WorkerPool workers;
+
+// Pre-drawn obstacles (null unless loaded with --obstacles)
+Tigr* obstacleLayer = nullptr;
+
+// Colors of the flock and its predators, from HUE
+TPixel boidColor, predatorColor;
+
+// Checkpoints, written on demand and every CHECKPOINT_INTERVAL steps (0 for never)
+std::string CHECKPOINT_FILE = "boids.snapshot";
+int CHECKPOINT_INTERVAL = 0;
+Checkpointer checkpointer;
+
+// Trajectory recording (off unless --record is given)
+const int RECORD_RING_FRAMES = 8;
+const uint32_t RECORD_KEYFRAME_INTERVAL = 64;
+TrajectoryRecorder recorder;
+const int REPLAY_LOOKAHEAD_FRAMES = 4;
+
+// Rewind timeline kept while the window is open (0 MB for none)
+size_t REWIND_BUDGET_MB = 512;
+RewindTimeline timeline;
+
+// Shared-memory publication of every step (off unless --shm is given)
+const uint32_t SHARED_STATE_MAGIC = 0x4d485342;  // "BSHM"
+const uint32_t SHARED_STATE_VERSION = 1;
+const uint32_t SHARED_STATE_SLOTS = 4;
+SharedStatePublisher sharedState;
+
+// Localhost streaming server (off unless --serve is given)
+const size_t STREAM_CLIENT_BACKLOG = 8 << 20;  // Bytes queued for a client before it counts as slow
+const uint32_t STREAM_MAX_STRIDE = 64;
+StreamServer streamServer;
 
-// Random number generator
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_real_distribution<> dis(0.0, 1.0);
+// Screen tiles, rebinned every frame
+TileRenderer tileRenderer;
+
+// View into the world, and the boids it may show (found again every frame)
+Camera camera;
+std::vector<uint32_t> visibleBoids;
+
+// Boid and predator sprites
+SpriteAtlas sprites;
+
+// Accumulation buffers for drawing very large flocks
+Heatmap heatmap;
+
+// Slider and instruction panels
+UiOverlay uiOverlay;
+
+// Trace output (written on exit and on the T hotkey)
+std::string traceFile;
 
 
 // 
@@ -157,53 +605,322 @@ std::uniform_real_distribution<> dis(0.0, 1.0);
 //     [commandBuffer waitUntilCompleted];
 // }
 
-int main() {
+int main(int argc, char* argv[]) {
+    int headlessSteps = 0;
+    int initialPredators = 0;
+    int validateSteps = 0;
+    bool selfTest = false;
+    std::string benchScalingPrefix;
+    bool benchRules = false;
+    std::string benchRenderPrefix;
+    std::vector<std::pair<int, int>> renderResolutions = {{1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+    std::vector<int> renderBoidCounts = {1000, 10000, 100000};
+    std::string goldenRecordFile, goldenCheckFile;
+    const char* obstacleFile = nullptr;
+    std::string loadSnapshotFile, saveSnapshotFile;
+    std::string recordFile, replayFile, watchName;
+    int servePort = 0;
+    int numWorlds = 0;
+    world.seed = (static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}();
+    world.workers = &workers;
+
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            world.seed = std::stoull(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            NUM_THREADS = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--boids" && i + 1 < argc) {
+            NUM_BOIDS = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--predators" && i + 1 < argc) {
+            initialPredators = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--backend" && i + 1 < argc) {
+            std::string backend = argv[++i];
+            world.params.backend = backend == "brute" ? BACKEND_BRUTE_FORCE : BACKEND_GRID;
+        } else if (arg == "--heatmap-boids" && i + 1 < argc) {
+            HEATMAP_BOIDS = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--renderer" && i + 1 < argc) {
+            std::string renderer = argv[++i];
+            RENDERER = renderer == "tigr" ? RENDER_TIGR : RENDER_TILED;
+        } else if (arg == "--bench-scaling" && i + 1 < argc) {
+            benchScalingPrefix = argv[++i];
+        } else if (arg == "--bench-rules") {
+            benchRules = true;
+        } else if (arg == "--bench-render" && i + 1 < argc) {
+            benchRenderPrefix = argv[++i];
+        } else if (arg == "--render-sizes" && i + 1 < argc) {
+            // Comma-separated WIDTHxHEIGHT list, e.g. 1280x720,3840x2160
+            renderResolutions.clear();
+            std::string list = argv[++i];
+            for (size_t start = 0; start < list.size();) {
+                size_t end = std::min(list.find(',', start), list.size());
+                int width = 0, height = 0;
+                if (sscanf(list.substr(start, end - start).c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                    renderResolutions.push_back({width, height});
+                }
+                start = end + 1;
+            }
+        } else if (arg == "--render-boids" && i + 1 < argc) {
+            // Comma-separated boid counts
+            renderBoidCounts.clear();
+            std::string list = argv[++i];
+            for (size_t start = 0; start < list.size();) {
+                size_t end = std::min(list.find(',', start), list.size());
+                renderBoidCounts.push_back(std::max(0, std::stoi(list.substr(start, end - start))));
+                start = end + 1;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            TRACING = true;
+            traceFile = argv[++i];
+        } else if (arg == "--perf") {
+            PERF_COUNTERS = true;
+        } else if (arg == "--golden-record" && i + 1 < argc) {
+            goldenRecordFile = argv[++i];
+        } else if (arg == "--golden-check" && i + 1 < argc) {
+            goldenCheckFile = argv[++i];
+        } else if (arg == "--fixed") {
+            world.params.mode = MODE_FIXED;
+        } else if (arg == "--selftest") {
+            selfTest = true;
+        } else if (arg == "--validate-fixed" && i + 1 < argc) {
+            validateSteps = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--headless" && i + 1 < argc) {
+            headlessSteps = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--world" && i + 1 < argc) {
+            int width = 0, height = 0;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                world.params.width = width;
+                world.params.height = height;
+                WORLD_FOLLOWS_WINDOW = false;
+            }
+        } else if (arg == "--obstacles" && i + 1 < argc) {
+            obstacleFile = argv[++i];
+        } else if (arg == "--load-snapshot" && i + 1 < argc) {
+            loadSnapshotFile = argv[++i];
+        } else if (arg == "--save-snapshot" && i + 1 < argc) {
+            saveSnapshotFile = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            CHECKPOINT_FILE = argv[++i];
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            CHECKPOINT_INTERVAL = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (arg == "--rewind-budget" && i + 1 < argc) {
+            REWIND_BUDGET_MB = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--shm" && i + 1 < argc) {
+            sharedState.name = argv[++i];
+            if (sharedState.name[0] != '/') sharedState.name = "/" + sharedState.name;
+        } else if (arg == "--shm-watch" && i + 1 < argc) {
+            watchName = argv[++i];
+            if (watchName[0] != '/') watchName = "/" + watchName;
+        } else if (arg == "--serve" && i + 1 < argc) {
+            servePort = std::stoi(argv[++i]);
+        } else if (arg == "--worlds" && i + 1 < argc) {
+            numWorlds = std::max(1, std::stoi(argv[++i]));
+        }
+    }
+
+    // Check the random number generator against its published outputs and exit
+    if (selfTest) {
+        return runSelfTest() ? 0 : 1;
+    }
+
+    // Follow another run's shared state instead of simulating
+    if (!watchName.empty()) {
+        return watchSharedState(watchName);
+    }
+
+    // A snapshot brings its own world and mode, so map it before anything is sized from the world
+    Snapshot snapshot;
+    if (!loadSnapshotFile.empty()) {
+        if (!mapSnapshot(loadSnapshotFile, snapshot)) {
+            std::cerr << "Not a snapshot file: " << loadSnapshotFile << std::endl;
+            return 1;
+        }
+        world.params.width = snapshot.header->worldWidth;
+        world.params.height = snapshot.header->worldHeight;
+        world.params.mode = snapshot.header->mode == MODE_FIXED ? MODE_FIXED : MODE_FLOAT;
+        WORLD_FOLLOWS_WINDOW = false;
+    }
+
+    if ((world.params.mode == MODE_FIXED || validateSteps > 0) && !fixedPointFits(world.params)) {
+        std::cerr << "Fixed-point mode supports worlds up to " << FIXED_MAX_WORLD_SIZE << " px a side, not "
+                  << world.params.width << "x" << world.params.height << std::endl;
+        return 1;
+    }
+
+    // The mask is stretched over the world, so wait until its size is known
+    if (obstacleFile && !loadObstacles(obstacleFile, world.obstacles)) {
+        std::cerr << "Could not load obstacle mask " << obstacleFile << std::endl;
+    }
+
+    // The scaling benchmark always tries to count
+    if (!benchScalingPrefix.empty()) PERF_COUNTERS = true;
+    openThreadPerfCounters();
+    startWorkers(workers, NUM_THREADS);
+
+    // Sweep boid and predator counts over every backend and exit
+    if (!benchScalingPrefix.empty()) {
+        bool written = runScalingBenchmark(benchScalingPrefix);
+        stopWorkers(workers);
+        return written ? 0 : 1;
+    }
+
+    // Time drawing into offscreen bitmaps at each resolution and flock size, then exit
+    if (!benchRenderPrefix.empty()) {
+        bool written = runRenderBenchmark(benchRenderPrefix, renderResolutions, renderBoidCounts, initialPredators,
+                                          snapshot.header ? &snapshot : nullptr);
+        stopWorkers(workers);
+        return written ? 0 : 1;
+    }
+
+    // Record reference trajectories, or check every backend against them, then exit
+    if (!goldenRecordFile.empty() || !goldenCheckFile.empty()) {
+        bool passed = goldenRecordFile.empty() ? checkGoldenTrajectories(goldenCheckFile)
+                                               : recordGoldenTrajectories(goldenRecordFile);
+        stopWorkers(workers);
+        return passed ? 0 : 1;
+    }
+
+    // Time each rule and check its optimized variants against it, then exit
+    if (benchRules) {
+        bool passed = runRuleBenchmarks();
+        stopWorkers(workers);
+        return passed ? 0 : 1;
+    }
+
+    // Compare the fixed-point mode against the float reference and exit
+    if (validateSteps > 0) {
+        bool passed = validateFixedMode(validateSteps);
+        stopWorkers(workers);
+        return passed ? 0 : 1;
+    }
+
+    // Step many independent worlds at once without a window, then exit
+    if (headlessSteps > 0 && numWorlds > 0) {
+        stopWorkers(workers);
+        runWorlds(numWorlds, headlessSteps, initialPredators);
+        if (TRACING) writeTrace(traceFile);
+        return 0;
+    }
+
+    // Run without a window and print a checksum of the final state, so runs can be
+    // compared across thread counts and machines
+    if (headlessSteps > 0) {
+        Flock& boids = world.boids;
+        Flock& predators = world.predators;
+        if (snapshot.header) {
+            restoreSnapshot(snapshot, boids, predators);
+            unmapSnapshot(snapshot);
+        } else {
+            initBoids(world, NUM_BOIDS);
+            initPredators(world, initialPredators);
+        }
+        if (!recordFile.empty() && !startRecorder(recorder, recordFile)) {
+            std::cerr << "Could not open recording " << recordFile << std::endl;
+        }
+        if (servePort > 0 && !startStreamServer(streamServer, servePort)) {
+            std::cerr << "Could not listen on port " << servePort << std::endl;
+        }
+        PerfSample updateCounters;
+        for (int step = 0; step < headlessSteps; step++) {
+            stepSimulation(world);
+            addPerfSample(updateCounters, world.phaseTimes.updateCounters);
+            autoCheckpoint(checkpointer, boids, predators);
+            recordFrame(recorder, boids, predators);
+            publishState(sharedState, boids, predators);
+            streamFrame(streamServer, boids, predators);
+        }
+        stopCheckpointer(checkpointer);
+        stopRecorder(recorder);
+        closeSharedState(sharedState);
+        stopStreamServer(streamServer);
+        if (PERF_COUNTERS) printPerfSummary("update", updateCounters, static_cast<double>(headlessSteps) * boids.size());
+        if (!saveSnapshotFile.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            if (!writeSnapshot(saveSnapshotFile, boids, predators)) {
+                std::cerr << "Could not write snapshot " << saveSnapshotFile << std::endl;
+            } else {
+                printf("snapshot of %zu boids written to %s in %.1f ms\n", boids.size(), saveSnapshotFile.c_str(),
+                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        stopWorkers(workers);
+        if (TRACING) writeTrace(traceFile);
+        printf("seed %llu, %s, %d threads, step %u: checksum %016llx\n",
+               static_cast<unsigned long long>(world.seed), world.params.mode == MODE_FIXED ? "fixed" : "float", NUM_THREADS, world.step,
+               static_cast<unsigned long long>(simulationChecksum(boids, predators)));
+        return 0;
+    }
+
+    // Play a recording back instead of simulating
+    if (!replayFile.empty()) {
+        int status = runReplay(replayFile);
+        stopWorkers(workers);
+        return status;
+    }
+
     // Initialize TIGR window
-    Tigr* screen = tigrWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Boids Simulation", 1);
+    Tigr* screen = tigrWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Boids Simulation", 1);
+    if (!WORLD_FOLLOWS_WINDOW) fitCamera(screen->w, screen->h);
     
     // setupMetal();
     // createBuffers(boids);
 
-    // Initialize boids
-    std::vector<Boid> boids(NUM_BOIDS);
-    initBoids(boids);
-
-    // Initialize predators
-    std::vector<Predator> predators(0);
+    // Initialize boids and predators, or pick up where a snapshot left off
+    Flock& boids = world.boids;
+    Flock& predators = world.predators;
+    if (snapshot.header) {
+        restoreSnapshot(snapshot, boids, predators);
+        unmapSnapshot(snapshot);
+    } else {
+        initBoids(world, NUM_BOIDS);
+        initPredators(world, initialPredators);
+    }
 
     // Initialize sliders
-    std::vector<Slider> sliders = {
-        {10, 10, 200, 20, 0.0f, 0.02f, CENTERING_FACTOR, "Centering Factor"},
-        {10, 40, 200, 20, 0.0f, 0.2f, AVOID_FACTOR, "Avoid Factor"},
-        {10, 70, 200, 20, 0.0f, 0.2f, MATCHING_FACTOR, "Matching Factor"},
-        {10, 100, 200, 20, 5.0f, 30.0f, SPEED_LIMIT, "Speed Limit"},
-        {10, 130, 200, 20, 0.0f, 100.0f, TRAIL_LENGTH, "Trail Length"},
-        {10, 160, 200, 20, 0.0f, 1.0f, HUE, "Color"},
-        {10, 190, 200, 20, 50.0f, 400.0f, MARGIN, "Margin"},
-        {10, 220, 200, 20, 0.1f, 3.0f, TURN_FACTOR, "Turn Factor"},
-        {10, 250, 200, 20, 1.0f, 10.0f, SIZE, "Size"}
-    };
+    std::vector<Slider> sliders = createSliders();
+
+    // Record every step from here on
+    if (!recordFile.empty() && !startRecorder(recorder, recordFile)) {
+        std::cerr << "Could not open recording " << recordFile << std::endl;
+    }
+    if (servePort > 0 && !startStreamServer(streamServer, servePort)) {
+        std::cerr << "Could not listen on port " << servePort << std::endl;
+    }
 
     bool lastMouseDown = false;
+    PerfSample perfUpdateTotal, perfDrawTotal;
+    double perfBoidSteps = 0, perfDrawnBoids = 0;
+    int perfFrames = 0;
     bool animationRunning = true;
     bool lastSpaceState = false;
 
     // Main loop
     while (!tigrClosed(screen) && !tigrKeyDown(screen, TK_ESCAPE)) {
-        // Clear screen
-        tigrClear(screen, tigrRGB(0, 0, 0));
-
-        SCREEN_WIDTH = screen->w;
-        SCREEN_HEIGHT = screen->h;
+        if (WORLD_FOLLOWS_WINDOW) {
+            world.params.width = screen->w;
+            world.params.height = screen->h;
+            if (world.params.mode == MODE_FIXED) {
+                world.params.width = std::min(world.params.width, FIXED_MAX_WORLD_SIZE);
+                world.params.height = std::min(world.params.height, FIXED_MAX_WORLD_SIZE);
+            }
+        }
+        float frameSeconds = std::min(tigrTime(), 0.1f);
 
         // Get mouse state
+        uint64_t phaseStart = traceBegin();
         int mouseX, mouseY, buttons;
         tigrMouse(screen, &mouseX, &mouseY, &buttons);
         bool mouseDown = (buttons & 1) != 0;
         bool rightMouseDown = (buttons & 2) != 0;
 
-        // Handle hotkeys
+        // Handle hotkeys, and pan and zoom the camera
         handleHotkeys(screen, boids, predators);
+        updateCamera(screen, frameSeconds);
 
         // Check space key to toggle animation
         bool currentSpaceState = tigrKeyDown(screen, TK_SPACE);
@@ -212,414 +929,2844 @@ int main() {
         }
         lastSpaceState = currentSpaceState;
 
-        // Update and draw sliders
+        // Scrub back through the timeline, or forward through what was rewound
+        updateRewind(screen, timeline, animationRunning, boids, predators);
+
+        // Write out what has been traced so far
+        if (TRACING && tigrKeyDown(screen, 'T')) {
+            writeTrace(traceFile);
+        }
+        traceEnd("input", phaseStart);
+
+        // Update sliders
+        phaseStart = traceBegin();
         bool onSlider = false;
         for (auto& slider : sliders) {
             updateSlider(slider, mouseX, mouseY, mouseDown);
-            drawSlider(screen, slider);
             if (mouseX >= slider.x - 20 && mouseX <= slider.x + slider.width + 20 &&
                 mouseY >= slider.y - 20 && mouseY <= slider.y + slider.height + 20) {
                 onSlider = true;
             }
         }
 
-        // Draw instructions in the top right corner
-        const char* instructions[] = {
-            "Hotkeys:",
-            "R: Reset simulation",
-            "Arrow keys: Nudge boids",
-            "Space: Pause/Resume",
-            "Left click: Add boid",
-            "Right click: Add predator",
-            "Esc: Quit"
-        };
-
-        int instructionX = SCREEN_WIDTH - 10;  // Start from right edge
-        int instructionY = 10;
-        TPixel textColor = tigrRGB(255, 255, 255);
-
-        for (const char* instruction : instructions) {
-            int textWidth = tigrTextWidth(tfont, instruction);
-            tigrPrint(screen, tfont, instructionX - textWidth, instructionY, textColor, instruction);
-            instructionY += 20;
-        }
-
-        // Add boids on left click/drag
+        // Add boids on left click/drag, at the world point under the mouse
+        float mouseWorldX = camera.x + mouseX / camera.zoom;
+        float mouseWorldY = camera.y + mouseY / camera.zoom;
         if (mouseDown && !onSlider) {
-            addBoid(boids, mouseX, mouseY);
+            addBoid(world, mouseWorldX, mouseWorldY);
         }
 
         // Add predator on right click
         if (rightMouseDown) {
-            addPredator(predators, mouseX, mouseY);
+            addPredator(world, mouseWorldX, mouseWorldY);
         }
 
         // Update parameters from sliders
-        CENTERING_FACTOR = sliders[0].currentValue;
-        AVOID_FACTOR = sliders[1].currentValue;
-        MATCHING_FACTOR = sliders[2].currentValue;
-        SPEED_LIMIT = sliders[3].currentValue;
-        TRAIL_LENGTH = sliders[4].currentValue;
+        world.params.centeringFactor = sliders[0].currentValue;
+        world.params.avoidFactor = sliders[1].currentValue;
+        world.params.matchingFactor = sliders[2].currentValue;
+        world.params.speedLimit = sliders[3].currentValue;
+        world.params.trailLength = sliders[4].currentValue;
         HUE = sliders[5].currentValue;
-        MARGIN = sliders[6].currentValue;
-        TURN_FACTOR = sliders[7].currentValue;
+        world.params.margin = sliders[6].currentValue;
+        world.params.turnFactor = sliders[7].currentValue;
         SIZE = sliders[8].currentValue;
 
-        // Update boid colors
-        TPixel boidColor = hsvToRgb(HUE, 1.0f, 1.0f);
-        for (auto& boid : boids) {
-            boid.color = boidColor;
-        }
-
-        // Update predator color to be opposite of boid color
-        float oppositePredatorHue = std::fmod(HUE + 0.5f, 1.0f);  // Add 0.5 to get the opposite hue, wrap around if > 1
-        for (auto& predator : predators) {
-            predator.color = hsvToRgb(oppositePredatorHue, 1.0f, 1.0f);
-        }
+        traceEnd("sliders", phaseStart);
 
         // Update and draw boids
         if (animationRunning) {
             // I need to work out a deltaTime method for the GPU to handle things
             // updateBoidsWithGPU(device, commandQueue, boidsBuffer, deltaTime, boids.size());
             // for now, let's just do it on the CPU
-            for (auto& boid : boids) {
-                updateBoid(boid, boids, predators);
-            }
-            for (auto& predator : predators) {
-                updatePredator(predator, boids, predators);
-            }
+            if (timeline.rewound) resumeFromTimeline(timeline);
+            stepSimulation(world);
+            autoCheckpoint(checkpointer, boids, predators);
+            recordFrame(recorder, boids, predators);
+            recordTimeline(timeline, boids, predators);
+            publishState(sharedState, boids, predators);
+            streamFrame(streamServer, boids, predators);
         }
-        for (auto& boid : boids) {
-            drawBoid(screen, boid);
+        auto drawStart = std::chrono::steady_clock::now();
+        PerfSample drawCounters = readPerfCounters();
+        RenderTimes renderTimes;
+        renderFrame(screen, boids, predators, sliders, renderTimes);
+        if (timeline.rewound) {
+            const TimelineFrame& shown = timeline.frames[timeline.shown];
+            tigrPrint(screen, tfont, 10, screen->h - 20, tigrRGB(255, 255, 255), "Step %u, %u steps back (Space resumes from here)",
+                      shown.step, timeline.frames.back().step - shown.step);
         }
-        for (auto& predator : predators) {
-            drawPredator(screen, predator);
+        world.phaseTimes.draw = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - drawStart).count();
+        world.phaseTimes.drawCounters = perfDelta(drawCounters, readPerfCounters());
+
+        // Print the hardware counters every couple of seconds
+        if (PERF_COUNTERS) {
+            if (animationRunning) {
+                addPerfSample(perfUpdateTotal, world.phaseTimes.updateCounters);
+                perfBoidSteps += boids.size();
+            }
+            addPerfSample(perfDrawTotal, world.phaseTimes.drawCounters);
+            perfDrawnBoids += boids.size();
+            if (++perfFrames == 120) {
+                printPerfSummary("update", perfUpdateTotal, perfBoidSteps);
+                printPerfSummary("draw", perfDrawTotal, perfDrawnBoids);
+                perfUpdateTotal = perfDrawTotal = PerfSample();
+                perfBoidSteps = perfDrawnBoids = 0;
+                perfFrames = 0;
+            }
         }
 
         // Update display
+        phaseStart = traceBegin();
         tigrUpdate(screen);
+        traceEnd("tigrUpdate", phaseStart);
 
         lastMouseDown = mouseDown;
     }
 
     // Clean up
     tigrFree(screen);
+    stopCheckpointer(checkpointer);
+    stopRecorder(recorder);
+    stopTimeline(timeline);
+    closeSharedState(sharedState);
+    stopStreamServer(streamServer);
+    stopWorkers(workers);
+    if (TRACING) writeTrace(traceFile);
     return 0;
 }
 
-void initBoids(std::vector<Boid>& boids) {
-    for (auto& boid : boids) {
-        boid.x = dis(gen) * SCREEN_WIDTH;
-        boid.y = dis(gen) * SCREEN_HEIGHT;
-        boid.dx = dis(gen) * 10 - 5;
-        boid.dy = dis(gen) * 10 - 5;
-        boid.color = hsvToRgb(HUE, 1.0f, 1.0f);
+// Run the same seeded scene in float and fixed point and compare flock metrics averaged
+// over the second half of the run. Trajectories diverge quickly (the flock is chaotic),
+// so only the statistics are expected to agree.
+bool validateFixedMode(int steps) {
+    FlockStats averages[2];
+    SimulationMode modes[2] = {MODE_FLOAT, MODE_FIXED};
+
+    for (int m = 0; m < 2; m++) {
+        World scene;
+        scene.params = world.params;
+        scene.params.mode = modes[m];
+        scene.seed = world.seed;
+        scene.workers = &workers;
+        initBoids(scene, NUM_BOIDS);
+
+        FlockStats sum = {0, 0, 0};
+        int samples = 0;
+        for (int step = 0; step < steps; step++) {
+            stepSimulation(scene);
+            if (step >= steps / 2) {
+                FlockStats stats = computeFlockStats(scene.boids);
+                sum.polarization += stats.polarization;
+                sum.meanSpeed += stats.meanSpeed;
+                sum.meanNeighborDistance += stats.meanNeighborDistance;
+                samples++;
+            }
+        }
+        averages[m] = {sum.polarization / samples, sum.meanSpeed / samples, sum.meanNeighborDistance / samples};
     }
-}
 
-void addBoid(std::vector<Boid>& boids, float x, float y) {
-    Boid newBoid;
-    newBoid.x = x;
-    newBoid.y = y;
-    newBoid.dx = dis(gen) * 10 - 5;
-    newBoid.dy = dis(gen) * 10 - 5;
-    newBoid.color = hsvToRgb(HUE, 1.0f, 1.0f);
-    boids.push_back(newBoid);
+    bool passed = flockStatsAgree(averages[0], averages[1]);
+
+    printf("%d boids, %d steps, seed %llu\n", NUM_BOIDS, steps, static_cast<unsigned long long>(world.seed));
+    printf("%-24s %10s %10s\n", "metric", "float", "fixed");
+    printf("%-24s %10.3f %10.3f\n", "polarization", averages[0].polarization, averages[1].polarization);
+    printf("%-24s %10.3f %10.3f\n", "mean speed", averages[0].meanSpeed, averages[1].meanSpeed);
+    printf("%-24s %10.3f %10.3f\n", "mean neighbor distance", averages[0].meanNeighborDistance, averages[1].meanNeighborDistance);
+    printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed;
 }
 
-void addPredator(std::vector<Predator>& predators, float x, float y) {
-    Predator newPredator;
-    newPredator.x = x;
-    newPredator.y = y;
-    newPredator.dx = dis(gen) * 10 - 5;
-    newPredator.dy = dis(gen) * 10 - 5;
-    predators.push_back(newPredator);
+// Check philox4x32 against the known-answer vectors published with Random123 (Philox4x32-10).
+// Every random draw goes through it, so a port or compiler that gets it wrong changes
+// every run of every seed.
+bool runSelfTest() {
+    struct KnownAnswer {
+        uint32_t key[2];
+        uint32_t counter[4];
+        uint32_t expected[4];
+    };
+    const KnownAnswer answers[] = {
+        {{0x00000000, 0x00000000}, {0x00000000, 0x00000000, 0x00000000, 0x00000000},
+         {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+         {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0xa4093822, 0x299f31d0}, {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+         {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}
+    };
+
+    bool passed = true;
+    for (const auto& answer : answers) {
+        uint32_t counter[4] = {answer.counter[0], answer.counter[1], answer.counter[2], answer.counter[3]};
+        philox4x32(answer.key[0], answer.key[1], counter);
+        bool match = memcmp(counter, answer.expected, sizeof(counter)) == 0;
+        passed &= match;
+        printf("philox4x32 key %08x %08x: %08x %08x %08x %08x %s\n", answer.key[0], answer.key[1], counter[0], counter[1],
+               counter[2], counter[3], match ? "ok" : "MISMATCH");
+    }
+    printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed;
 }
 
-float distance(const Boid& b1, const Boid& b2) {
-    float dx = b1.x - b2.x;
-    float dy = b1.y - b2.y;
-    return std::sqrt(dx * dx + dy * dy);
+// Step numWorlds independent worlds of NUM_BOIDS boids each, seeded from --seed upwards,
+// and print each one's checksum. Every world is stepped whole by one of NUM_THREADS
+// threads, with no pool of its own, so world 0 ends up the same as a --headless run.
+void runWorlds(int numWorlds, int steps, int numPredators) {
+    std::vector<World> worlds(numWorlds);
+    for (int i = 0; i < numWorlds; i++) {
+        worlds[i].params = world.params;
+        worlds[i].seed = world.seed + i;
+        worlds[i].obstacles = world.obstacles;
+        initBoids(worlds[i], NUM_BOIDS);
+        initPredators(worlds[i], numPredators);
+    }
+
+    // Each thread takes the next world nobody has stepped yet
+    std::atomic<int> nextWorld{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min(NUM_THREADS, numWorlds); t++) {
+        threads.emplace_back([&, t] {
+            setTraceThreadName("world thread " + std::to_string(t));
+            for (int i = nextWorld++; i < numWorlds; i = nextWorld++) {
+                for (int step = 0; step < steps; step++) {
+                    stepSimulation(worlds[i]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < numWorlds; i++) {
+        printf("world %d, seed %llu, step %u: checksum %016llx\n", i, static_cast<unsigned long long>(worlds[i].seed),
+               worlds[i].step, static_cast<unsigned long long>(simulationChecksum(worlds[i].boids, worlds[i].predators)));
+    }
+    printf("%d worlds of %d boids, %d threads: %.1f ms, %.2f M boid-steps/s\n", numWorlds, NUM_BOIDS,
+           std::min(NUM_THREADS, numWorlds), seconds * 1000,
+           static_cast<double>(numWorlds) * NUM_BOIDS * steps / seconds / 1e6);
 }
 
-float distance(const Predator& p1, const Predator& p2) {
-    float dx = p1.x - p2.x;
-    float dy = p1.y - p2.y;
-    return std::sqrt(dx * dx + dy * dy);
+// Peak resident set size in megabytes. On Linux the peak is reset before each benchmark
+// point, elsewhere it is the high-water mark of the whole process.
+void resetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs) clearRefs << "5";
 }
 
-float distance(const Boid& boid, const Predator& predator) {
-    float dx = boid.x - predator.x;
-    float dy = boid.y - predator.y;
-    return std::sqrt(dx * dx + dy * dy);
+double peakRssMb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stod(line.substr(6)) / 1024.0;
+        }
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
 }
 
-void keepWithinBounds(Boid& boid) {
-    if (boid.x < MARGIN) boid.dx += TURN_FACTOR;
-    if (boid.x > SCREEN_WIDTH - MARGIN) boid.dx -= TURN_FACTOR;
-    if (boid.y < MARGIN) boid.dy += TURN_FACTOR;
-    if (boid.y > SCREEN_HEIGHT - MARGIN) boid.dy -= TURN_FACTOR;
+// One point of the scaling sweep
+struct ScalingResult {
+    const char* backend;
+    int boids, predators;
+    int worldWidth, worldHeight;
+    int steps;
+    double nsPerBoidStep;
+    double updateMs, predatorMs, drawMs;
+    double frameP50, frameP95, frameP99;
+    double peakRss;
+    PerfSample updateCounters, drawCounters; // Totals over the measured steps
+};
+
+// Per boid-step hardware counter columns, shared by the benchmark CSV header, its rows and
+// the JSON so they can't drift apart
+const char* const perfColumns[] = {
+    "cycles_per_boid_step", "instructions_per_boid_step", "ipc", "llc_misses_per_boid_step",
+    "branch_misses_per_boid_step",
+};
+const int NUM_PERF_COLUMNS = sizeof(perfColumns) / sizeof(perfColumns[0]);
+
+// The counter columns' values, in perfColumns order
+void perfColumnValues(const PerfSample& counters, double boidSteps, double values[NUM_PERF_COLUMNS]) {
+    values[0] = counters.cycles / boidSteps;
+    values[1] = counters.instructions / boidSteps;
+    values[2] = counters.cycles ? static_cast<double>(counters.instructions) / counters.cycles : 0.0;
+    values[3] = counters.cacheMisses / boidSteps;
+    values[4] = counters.branchMisses / boidSteps;
 }
 
-void flyTowardsCenter(Boid& boid, const std::vector<Boid>& boids) {
-    float centerX = 0, centerY = 0;
-    int numNeighbors = 0;
+// The counter column names for one phase, for the CSV header
+void writePerfCsvHeader(std::ostream& out, const char* phase) {
+    for (const char* column : perfColumns) out << "," << phase << "_" << column;
+}
 
-    for (const auto& otherBoid : boids) {
-        if (distance(boid, otherBoid) < VISUAL_RANGE) {
-            centerX += otherBoid.x;
-            centerY += otherBoid.y;
-            numNeighbors++;
-        }
+// The counter columns for one phase as CSV fields, empty when unavailable
+void writePerfCsv(std::ostream& out, const PerfSample& counters, double boidSteps) {
+    double values[NUM_PERF_COLUMNS];
+    perfColumnValues(counters, boidSteps, values);
+    for (double value : values) {
+        out << ",";
+        if (counters.valid) out << value;
     }
+}
 
-    if (numNeighbors) {
-        centerX /= numNeighbors;
-        centerY /= numNeighbors;
-        boid.dx += (centerX - boid.x) * CENTERING_FACTOR;
-        boid.dy += (centerY - boid.y) * CENTERING_FACTOR;
+// The same columns as JSON fields, null when unavailable
+void writePerfJson(std::ostream& out, const char* phase, const PerfSample& counters, double boidSteps) {
+    double values[NUM_PERF_COLUMNS];
+    perfColumnValues(counters, boidSteps, values);
+    for (int i = 0; i < NUM_PERF_COLUMNS; i++) {
+        out << ", \"" << phase << "_" << perfColumns[i] << "\": ";
+        if (counters.valid) {
+            out << values[i];
+        } else {
+            out << "null";
+        }
     }
 }
 
-void avoidOthers(Boid& boid, const std::vector<Boid>& boids) {
-    const float minDistance = 20;
-    float moveX = 0, moveY = 0;
+// Sweep boid counts (100 to 1M, log-spaced) and predator counts (0 to 1000) over every
+// neighbor backend, and write the results as <prefix>.json and <prefix>.csv. The world
+// grows with the flock to keep the density of the default 1280x720 window with 1000
+// boids, and frames are drawn into an offscreen bitmap of the default window size.
+bool runScalingBenchmark(const std::string& outputPrefix) {
+    const int boidCounts[] = {100, 316, 1000, 3162, 10000, 31623, 100000, 316228, 1000000};
+    const int predatorCounts[] = {0, 10, 100, 1000};
+    const NeighborBackend backends[] = {BACKEND_BRUTE_FORCE, BACKEND_GRID};
+    const char* backendNames[] = {"brute", "grid"};
+    const int warmupSteps = 2, minSteps = 3, maxSteps = 30;
+    const double pointBudgetMs = 3000, slowFrameMs = 2000;
+    const double areaPerBoid = 1280.0 * 720.0 / 1000.0;
+
+    int savedWidth = world.params.width, savedHeight = world.params.height;
+    NeighborBackend savedBackend = world.params.backend;
+    Tigr* canvas = tigrBitmap(savedWidth, savedHeight);
+    std::vector<ScalingResult> results;
+    updateColors();
+
+    for (int b = 0; b < 2; b++) {
+        world.params.backend = backends[b];
+        for (int numPredators : predatorCounts) {
+            for (int numBoids : boidCounts) {
+                double aspect = 16.0 / 9.0;
+                world.params.height = std::max(1, static_cast<int>(std::sqrt(numBoids * areaPerBoid / aspect)));
+                world.params.width = std::max(1, static_cast<int>(world.params.height * aspect));
+                if (world.params.mode == MODE_FIXED && !fixedPointFits(world.params)) {
+                    fprintf(stderr, "%-5s N=%-8d P=%-5d skipped, world too large for fixed point\n",
+                            backendNames[b], numBoids, numPredators);
+                    continue;
+                }
+                resetWorld(world);
+                resetPeakRss();
+                initBoids(world, numBoids);
+                initPredators(world, numPredators);
+                const Flock& boids = world.boids;
+                const Flock& predators = world.predators;
 
-    for (const auto& otherBoid : boids) {
-        if (&otherBoid != &boid) {
-            if (distance(boid, otherBoid) < minDistance) {
-                moveX += boid.x - otherBoid.x;
-                moveY += boid.y - otherBoid.y;
+                std::vector<double> frameTimes;
+                double updateMs = 0, predatorMs = 0, drawMs = 0, elapsed = 0;
+                PerfSample updateCounters, drawCounters;
+                for (int step = 0; step < warmupSteps + maxSteps; step++) {
+                    auto frameStart = std::chrono::steady_clock::now();
+                    stepSimulation(world);
+                    auto drawStart = std::chrono::steady_clock::now();
+                    PerfSample drawBefore = readPerfCounters();
+                    tigrClear(canvas, tigrRGB(0, 0, 0));
+                    for (size_t i = 0; i < boids.size(); i++) drawTrail(canvas, boids, i);
+                    for (size_t i = 0; i < boids.size(); i++) drawBoid(canvas, loadBoid(boids, i));
+                    for (size_t i = 0; i < predators.size(); i++) drawPredator(canvas, loadPredator(predators, i));
+                    PerfSample drawAfter = readPerfCounters();
+                    auto frameEnd = std::chrono::steady_clock::now();
+
+                    double frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+                    elapsed += frameMs;
+                    if (step >= warmupSteps) {
+                        frameTimes.push_back(frameMs);
+                        updateMs += world.phaseTimes.update;
+                        predatorMs += world.phaseTimes.predators;
+                        drawMs += std::chrono::duration<double, std::milli>(frameEnd - drawStart).count();
+                        addPerfSample(updateCounters, world.phaseTimes.updateCounters);
+                        addPerfSample(drawCounters, perfDelta(drawBefore, drawAfter));
+                    }
+                    if (static_cast<int>(frameTimes.size()) >= minSteps && elapsed > pointBudgetMs) break;
+                }
+
+                ScalingResult result;
+                int steps = static_cast<int>(frameTimes.size());
+                std::sort(frameTimes.begin(), frameTimes.end());
+                auto percentile = [&](double p) { return frameTimes[std::min(steps - 1, static_cast<int>(p * steps))]; };
+                result.backend = backendNames[b];
+                result.boids = numBoids;
+                result.predators = numPredators;
+                result.worldWidth = world.params.width;
+                result.worldHeight = world.params.height;
+                result.steps = steps;
+                result.updateMs = updateMs / steps;
+                result.predatorMs = predatorMs / steps;
+                result.drawMs = drawMs / steps;
+                result.nsPerBoidStep = (updateMs + predatorMs) / steps * 1e6 / numBoids;
+                result.frameP50 = percentile(0.50);
+                result.frameP95 = percentile(0.95);
+                result.frameP99 = percentile(0.99);
+                result.peakRss = peakRssMb();
+                result.updateCounters = updateCounters;
+                result.drawCounters = drawCounters;
+                results.push_back(result);
+
+                fprintf(stderr, "%-5s N=%-8d P=%-5d %10.1f ns/boid-step  p50 %9.2f ms  rss %8.1f MB\n",
+                        result.backend, numBoids, numPredators, result.nsPerBoidStep, result.frameP50, result.peakRss);
+
+                // Larger flocks would only be slower, leave them out for this backend
+                if (result.frameP50 > slowFrameMs) {
+                    fprintf(stderr, "%-5s P=%-5d skipping larger flocks\n", result.backend, numPredators);
+                    break;
+                }
             }
         }
     }
 
-    boid.dx += moveX * AVOID_FACTOR;
-    boid.dy += moveY * AVOID_FACTOR;
+    tigrFree(canvas);
+    world.params.width = savedWidth;
+    world.params.height = savedHeight;
+    world.params.backend = savedBackend;
+
+    std::ofstream json(outputPrefix + ".json");
+    std::ofstream csv(outputPrefix + ".csv");
+    if (!json || !csv) return false;
+
+    csv << "backend,boids,predators,world_width,world_height,steps,ns_per_boid_step,update_ms,predator_ms,draw_ms,"
+           "frame_p50_ms,frame_p95_ms,frame_p99_ms,peak_rss_mb";
+    writePerfCsvHeader(csv, "update");
+    writePerfCsvHeader(csv, "draw");
+    csv << "\n";
+    json << "{\n  \"threads\": " << NUM_THREADS << ",\n  \"seed\": " << world.seed << ",\n  \"points\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScalingResult& r = results[i];
+        double boidSteps = static_cast<double>(r.steps) * r.boids;
+        csv << r.backend << "," << r.boids << "," << r.predators << "," << r.worldWidth << "," << r.worldHeight << ","
+            << r.steps << "," << r.nsPerBoidStep << "," << r.updateMs << "," << r.predatorMs << "," << r.drawMs << ","
+            << r.frameP50 << "," << r.frameP95 << "," << r.frameP99 << "," << r.peakRss;
+        writePerfCsv(csv, r.updateCounters, boidSteps);
+        writePerfCsv(csv, r.drawCounters, boidSteps);
+        csv << "\n";
+        json << "    {\"backend\": \"" << r.backend << "\", \"boids\": " << r.boids << ", \"predators\": " << r.predators
+             << ", \"world_width\": " << r.worldWidth << ", \"world_height\": " << r.worldHeight << ", \"steps\": " << r.steps
+             << ", \"ns_per_boid_step\": " << r.nsPerBoidStep << ", \"update_ms\": " << r.updateMs
+             << ", \"predator_ms\": " << r.predatorMs << ", \"draw_ms\": " << r.drawMs
+             << ", \"frame_p50_ms\": " << r.frameP50 << ", \"frame_p95_ms\": " << r.frameP95
+             << ", \"frame_p99_ms\": " << r.frameP99 << ", \"peak_rss_mb\": " << r.peakRss;
+        writePerfJson(json, "update", r.updateCounters, boidSteps);
+        writePerfJson(json, "draw", r.drawCounters, boidSteps);
+        json << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+    return true;
 }
 
-void avoidPredator(Boid& boid, const std::vector<Predator>& predators) {
-    float moveX = 0, moveY = 0;
+// Render timings of one renderer at one resolution and flock size
+struct RenderResult {
+    const char* renderer;
+    int width, height;
+    int boids, predators;
+    int frames;
+    RenderTimes mean;
+    double frameP50, frameP95;
+};
+
+// Render the same flocks into offscreen bitmaps with every renderer at every resolution,
+// and write per-phase draw times as <prefix>.json and <prefix>.csv. The simulation still
+// steps between frames so trails and headings move as they would on screen, but only
+// drawing is timed. Each flock fills a world the size of the bitmap, unless a snapshot
+// is given: then its warmed-up flock is restored for every point instead, with the
+// camera fitting its world into the bitmap. The tiled renderer is also checked against
+// a single tile covering the whole screen, which draws every item on one thread;
+// returns false if any pixel differs.
+bool runRenderBenchmark(const std::string& outputPrefix, const std::vector<std::pair<int, int>>& resolutions,
+                        const std::vector<int>& boidCounts, int numPredators, const Snapshot* snapshot) {
+    const int minFrames = 3, maxFrames = 60;
+    const double pointBudgetMs = 2000;
+    const Renderer renderers[] = {RENDER_TIGR, RENDER_TILED};
+    const char* rendererNames[] = {"tigr", "tiled"};
 
-    for (const auto& predator : predators) {
-        if (distance(boid, predator) < VISUAL_RANGE) {
-            moveX += boid.x - predator.x;
-            moveY += boid.y - predator.y;
-        }
+    int savedWidth = world.params.width, savedHeight = world.params.height;
+    Renderer savedRenderer = RENDERER;
+    Camera savedCamera = camera;
+    std::vector<Slider> sliders = createSliders();
+    std::vector<RenderResult> results;
+    bool passed = true;
+    updateColors();
+
+    std::vector<int> flockSizes = boidCounts;
+    if (snapshot) {
+        flockSizes = {static_cast<int>(snapshot->header->numBoids)};
+        numPredators = static_cast<int>(snapshot->header->numPredators);
     }
+    for (int numBoids : flockSizes) {
+        for (const auto& resolution : resolutions) {
+            if (!snapshot && world.params.mode == MODE_FIXED &&
+                std::max(resolution.first, resolution.second) > FIXED_MAX_WORLD_SIZE) {
+                fprintf(stderr, "%5dx%-5d N=%-8d skipped, world too large for fixed point\n", resolution.first,
+                        resolution.second, numBoids);
+                continue;
+            }
+            for (int r = 0; r < 2; r++) {
+                RENDERER = renderers[r];
+                Tigr* canvas = tigrBitmap(resolution.first, resolution.second);
+                resetWorld(world);
+                Flock& boids = world.boids;
+                Flock& predators = world.predators;
+                if (snapshot) {
+                    restoreSnapshot(*snapshot, boids, predators);
+                    fitCamera(canvas->w, canvas->h);
+                    updateColors();
+                } else {
+                    world.params.width = resolution.first;
+                    world.params.height = resolution.second;
+                    initBoids(world, numBoids);
+                    initPredators(world, numPredators);
 
-    boid.dx += moveX * PREDATOR_FEAR_FACTOR;
-    boid.dy += moveY * PREDATOR_FEAR_FACTOR;
-}
+                    // Fill the trails before timing anything
+                    for (int step = 0; step < static_cast<int>(world.params.trailLength); step++) {
+                        stepSimulation(world);
+                    }
+                }
+
+                if (RENDERER == RENDER_TILED) {
+                    // The tiled frame must match what tigr itself draws for the same step
+                    RenderTimes unused;
+                    size_t numPixels = static_cast<size_t>(canvas->w) * canvas->h;
+                    RENDERER = RENDER_TIGR;
+                    renderFrame(canvas, boids, predators, sliders, unused);
+                    std::vector<TPixel> reference(canvas->pix, canvas->pix + numPixels);
+                    RENDERER = RENDER_TILED;
+                    renderFrame(canvas, boids, predators, sliders, unused);
+                    size_t mismatches = 0;
+                    for (size_t i = 0; i < numPixels; i++) {
+                        if (memcmp(&reference[i], &canvas->pix[i], sizeof(TPixel)) != 0) mismatches++;
+                    }
+                    if (mismatches > 0) {
+                        fprintf(stderr, "%5dx%-5d N=%-8d tiled render differs from the tigr render in %zu pixels\n",
+                                canvas->w, canvas->h, numBoids, mismatches);
+                        passed = false;
+                    }
+                }
 
-void matchVelocity(Boid& boid, const std::vector<Boid>& boids) {
-    float avgDX = 0, avgDY = 0;
-    int numNeighbors = 0;
+                RenderResult result = {rendererNames[r], canvas->w, canvas->h, numBoids, numPredators, 0, RenderTimes(), 0, 0};
+                std::vector<double> frameTimes;
+                double elapsed = 0;
+                for (int frame = 0; frame < maxFrames; frame++) {
+                    stepSimulation(world);
+                    RenderTimes times;
+                    renderFrame(canvas, boids, predators, sliders, times);
+                    double frameMs = times.clear + times.trails + times.boids + times.predators + times.ui + times.bin +
+                                     times.tiles + times.heatmap;
+                    frameTimes.push_back(frameMs);
+                    result.mean.clear += times.clear;
+                    result.mean.trails += times.trails;
+                    result.mean.boids += times.boids;
+                    result.mean.predators += times.predators;
+                    result.mean.ui += times.ui;
+                    result.mean.bin += times.bin;
+                    result.mean.tiles += times.tiles;
+                    result.mean.heatmap += times.heatmap;
+                    elapsed += frameMs;
+                    if (static_cast<int>(frameTimes.size()) >= minFrames && elapsed > pointBudgetMs) break;
+                }
+                tigrFree(canvas);
 
-    for (const auto& otherBoid : boids) {
-        if (distance(boid, otherBoid) < VISUAL_RANGE) {
-            avgDX += otherBoid.dx;
-            avgDY += otherBoid.dy;
-            numNeighbors++;
+                int frames = static_cast<int>(frameTimes.size());
+                std::sort(frameTimes.begin(), frameTimes.end());
+                result.frames = frames;
+                result.mean.clear /= frames;
+                result.mean.trails /= frames;
+                result.mean.boids /= frames;
+                result.mean.predators /= frames;
+                result.mean.ui /= frames;
+                result.mean.bin /= frames;
+                result.mean.tiles /= frames;
+                result.mean.heatmap /= frames;
+                result.frameP50 = frameTimes[frames / 2];
+                result.frameP95 = frameTimes[std::min(frames - 1, static_cast<int>(0.95 * frames))];
+                results.push_back(result);
+
+                if (RENDERER == RENDER_TILED) {
+                    fprintf(stderr, "%-5s %5dx%-5d N=%-8d bin %8.2f  tiles %8.2f  heatmap %8.2f  ui %6.2f  p50 %8.2f ms\n",
+                            result.renderer, result.width, result.height, numBoids, result.mean.bin, result.mean.tiles,
+                            result.mean.heatmap, result.mean.ui, result.frameP50);
+                } else {
+                    fprintf(stderr, "%-5s %5dx%-5d N=%-8d clear %7.2f  trails %8.2f  boids %8.2f  predators %6.2f  "
+                            "heatmap %8.2f  ui %6.2f  p50 %8.2f ms\n",
+                            result.renderer, result.width, result.height, numBoids, result.mean.clear, result.mean.trails,
+                            result.mean.boids, result.mean.predators, result.mean.heatmap, result.mean.ui, result.frameP50);
+                }
+            }
         }
     }
 
-    if (numNeighbors) {
-        avgDX /= numNeighbors;
-        avgDY /= numNeighbors;
-        boid.dx += (avgDX - boid.dx) * MATCHING_FACTOR;
-        boid.dy += (avgDY - boid.dy) * MATCHING_FACTOR;
-    }
-}
+    world.params.width = savedWidth;
+    world.params.height = savedHeight;
+    RENDERER = savedRenderer;
+    camera = savedCamera;
 
-void limitSpeed(Boid& boid) {
-    float speed = std::sqrt(boid.dx * boid.dx + boid.dy * boid.dy);
-    if (speed > SPEED_LIMIT) {
-        boid.dx = (boid.dx / speed) * SPEED_LIMIT;
-        boid.dy = (boid.dy / speed) * SPEED_LIMIT;
+    std::ofstream json(outputPrefix + ".json");
+    std::ofstream csv(outputPrefix + ".csv");
+    if (!json || !csv) return false;
+
+    csv << "renderer,width,height,boids,predators,frames,clear_ms,trails_ms,boids_ms,predators_ms,ui_ms,bin_ms,tiles_ms,"
+           "heatmap_ms,frame_p50_ms,frame_p95_ms\n";
+    json << "{\n  \"threads\": " << NUM_THREADS << ",\n  \"seed\": " << world.seed << ",\n  \"points\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const RenderResult& r = results[i];
+        csv << r.renderer << "," << r.width << "," << r.height << "," << r.boids << "," << r.predators << "," << r.frames << ","
+            << r.mean.clear << "," << r.mean.trails << "," << r.mean.boids << "," << r.mean.predators << ","
+            << r.mean.ui << "," << r.mean.bin << "," << r.mean.tiles << "," << r.mean.heatmap << "," << r.frameP50 << ","
+            << r.frameP95 << "\n";
+        json << "    {\"renderer\": \"" << r.renderer << "\", \"width\": " << r.width << ", \"height\": " << r.height
+             << ", \"boids\": " << r.boids << ", \"predators\": " << r.predators << ", \"frames\": " << r.frames
+             << ", \"clear_ms\": " << r.mean.clear << ", \"trails_ms\": " << r.mean.trails << ", \"boids_ms\": " << r.mean.boids
+             << ", \"predators_ms\": " << r.mean.predators << ", \"ui_ms\": " << r.mean.ui << ", \"bin_ms\": " << r.mean.bin
+             << ", \"tiles_ms\": " << r.mean.tiles << ", \"heatmap_ms\": " << r.mean.heatmap << ", \"frame_p50_ms\": " << r.frameP50
+             << ", \"frame_p95_ms\": " << r.frameP95 << "}" << (i + 1 < results.size() ? ",\n" : "\n");
     }
+    json << "  ]\n}\n";
+    return passed;
 }
 
-void updateBoid(Boid& boid, const std::vector<Boid>& boids, const std::vector<Predator>& predators) {
-    flyTowardsCenter(boid, boids);
-    avoidOthers(boid, boids);
-    avoidPredator(boid, predators);
-    matchVelocity(boid, boids);
-    limitSpeed(boid);
-    keepWithinBounds(boid);
+// A rule applied to one boid, reading neighbors from the snapshot
+typedef std::function<void(Boid& boid, const std::vector<Boid>& snapshot, const Flock& predators)> BoidRule;
 
-    boid.x += boid.dx;
-    boid.y += boid.dy;
+// A rule applied to every boid of a scene
+typedef std::function<void(std::vector<Boid>& boids, const std::vector<Boid>& snapshot,
+                           const Flock& predators)> RuleKernel;
 
-    boid.history.push_back({boid.x, boid.y});
-    while (boid.history.size() > static_cast<size_t>(TRAIL_LENGTH)) {
-        boid.history.erase(boid.history.begin());
-    }
+// An optimized version of a rule, and how far its output may drift from the reference
+struct RuleVariant {
+    const char* name;
+    RuleKernel kernel;
+    float tolerance;
+};
+
+struct RuleBenchmark {
+    const char* rule;
+    BoidRule reference;
+    std::vector<RuleVariant> variants;
+};
+
+// Run a per-boid rule over all boids on the calling thread
+RuleKernel serialRule(const BoidRule& rule) {
+    return [rule](std::vector<Boid>& boids, const std::vector<Boid>& snapshot, const Flock& predators) {
+        for (auto& boid : boids) rule(boid, snapshot, predators);
+    };
 }
 
-void updatePredator(Predator& predator, const std::vector<Boid>& boids, const std::vector<Predator>& predators) {
-    if (boids.empty()) return;
+// Run a per-boid rule over all boids on the worker pool
+RuleKernel parallelRule(const BoidRule& rule) {
+    return [rule](std::vector<Boid>& boids, const std::vector<Boid>& snapshot, const Flock& predators) {
+        parallelFor(workers, boids.size(), 64, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; i++) rule(boids[i], snapshot, predators);
+        });
+    };
+}
 
-    // Calculate the center of mass of nearby boids
-    float centerX = 0, centerY = 0;
-    int nearbyCount = 0;
-    float detectionRange = 150.0f; // Adjust this value as needed
+// Structure-of-arrays versions of the rules that only read the boid itself: gather the
+// fields into flat arrays, run branch-free loops the compiler can vectorize, and scatter
+// the velocities back. Gathering and scattering are part of the timing.
+RuleKernel soaKeepWithinBounds(const WorldParams& params) {
+    return [&params](std::vector<Boid>& boids, const std::vector<Boid>&, const Flock&) {
+        size_t n = boids.size();
+        std::vector<float> x(n), y(n), dx(n), dy(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = boids[i].x;
+            y[i] = boids[i].y;
+            dx[i] = boids[i].dx;
+            dy[i] = boids[i].dy;
+        }
+        float turn = params.turnFactor, margin = params.margin;
+        float right = params.width - margin, bottom = params.height - margin;
+        for (size_t i = 0; i < n; i++) {
+            dx[i] += x[i] < margin ? turn : 0.0f;
+            dx[i] -= x[i] > right ? turn : 0.0f;
+            dy[i] += y[i] < margin ? turn : 0.0f;
+            dy[i] -= y[i] > bottom ? turn : 0.0f;
+        }
+        for (size_t i = 0; i < n; i++) {
+            boids[i].dx = dx[i];
+            boids[i].dy = dy[i];
+        }
+    };
+}
 
-    for (const auto& boid : boids) {
-        float dist = distance(boid, predator);
-        if (dist < detectionRange) {
-            centerX += boid.x;
-            centerY += boid.y;
-            nearbyCount++;
+// Compares squared speeds, so the square root and division are only paid for in a
+// select, and scales by limit / speed instead of dividing each component
+RuleKernel soaLimitSpeed(const WorldParams& params) {
+    return [&params](std::vector<Boid>& boids, const std::vector<Boid>&, const Flock&) {
+        size_t n = boids.size();
+        std::vector<float> dx(n), dy(n);
+        for (size_t i = 0; i < n; i++) {
+            dx[i] = boids[i].dx;
+            dy[i] = boids[i].dy;
         }
-    }
+        float limit = params.speedLimit, limit2 = limit * limit;
+        for (size_t i = 0; i < n; i++) {
+            float speed2 = dx[i] * dx[i] + dy[i] * dy[i];
+            float scale = speed2 > limit2 ? limit / std::sqrt(speed2) : 1.0f;
+            dx[i] *= scale;
+            dy[i] *= scale;
+        }
+        for (size_t i = 0; i < n; i++) {
+            boids[i].dx = dx[i];
+            boids[i].dy = dy[i];
+        }
+    };
+}
 
-    if (nearbyCount > 0) {
-        centerX /= nearbyCount;
-        centerY /= nearbyCount;
+// Time every rule and its optimized variants on the same seeded scene, and check that each
+// variant's velocities stay within its tolerance of the scalar rule. Returns false if
+// any variant drifts too far.
+bool runRuleBenchmarks() {
+    const uint64_t sceneSeed = 1;
+    const int numPredators = 10;
+    const int warmupSteps = 20;
+    const double minTimeMs = 200;
 
-        float chaseFactor = 0.05f; // Reduced from 0.1f to make predator slower
-        predator.dx += (centerX - predator.x) * chaseFactor;
-        predator.dy += (centerY - predator.y) * chaseFactor;
+    // Build the scene: a seeded flock that has had a few steps to bunch up
+    World sceneWorld;
+    sceneWorld.params = world.params;
+    sceneWorld.seed = sceneSeed;
+    sceneWorld.workers = &workers;
+    initBoids(sceneWorld, NUM_BOIDS);
+    initPredators(sceneWorld, numPredators);
+    for (int step = 0; step < warmupSteps; step++) {
+        stepSimulation(sceneWorld);
     }
+    std::vector<Boid> scene(sceneWorld.boids.size());
+    for (size_t i = 0; i < scene.size(); i++) scene[i] = loadBoid(sceneWorld.boids, i);
+    const Flock& predators = sceneWorld.predators;
+    const std::vector<Boid> snapshot = scene;
+    const WorldParams& params = sceneWorld.params;
+    SpatialGrid& grid = sceneWorld.grid;
+    buildGrid(grid, snapshot, VISUAL_RANGE, params.width, params.height);
+
+    auto neighborRules = [&](Boid& boid, const std::vector<Boid>& boids, const Flock& predators) {
+        flyTowardsCenter(boid, boids, params);
+        avoidOthers(boid, boids, params);
+        avoidPredator(boid, predators);
+        matchVelocity(boid, boids, params);
+    };
+    auto neighborRulesGrid = [&](Boid& boid, const std::vector<Boid>&, const Flock& predators) {
+        applyNeighborRulesGrid(boid, grid, predators, params);
+    };
 
-    // Add randomness to predator movement
-    float randomFactor = 0.3f; // Reduced from 0.5f to make movement less erratic
-    predator.dx += (dis(gen) * 2 - 1) * randomFactor;
-    predator.dy += (dis(gen) * 2 - 1) * randomFactor;
+    std::vector<RuleBenchmark> benchmarks = {
+        {"flyTowardsCenter", [&](Boid& b, const std::vector<Boid>& s, const Flock&) { flyTowardsCenter(b, s, params); }, {}},
+        {"avoidOthers", [&](Boid& b, const std::vector<Boid>& s, const Flock&) { avoidOthers(b, s, params); }, {}},
+        {"avoidPredator", [](Boid& b, const std::vector<Boid>&, const Flock& p) { avoidPredator(b, p); }, {}},
+        {"matchVelocity", [&](Boid& b, const std::vector<Boid>& s, const Flock&) { matchVelocity(b, s, params); }, {}},
+        {"limitSpeed", [&](Boid& b, const std::vector<Boid>&, const Flock&) { limitSpeed(b, params); }, {
+            {"soa", soaLimitSpeed(params), 1e-5f}
+        }},
+        {"keepWithinBounds", [&](Boid& b, const std::vector<Boid>&, const Flock&) { keepWithinBounds(b, params); }, {
+            {"soa", soaKeepWithinBounds(params), 0.0f}
+        }},
+        {"neighbor rules", neighborRules, {
+            {"grid", serialRule(neighborRulesGrid), 1e-3f},
+            {"grid, parallel", parallelRule(neighborRulesGrid), 1e-3f}
+        }}
+    };
 
-    // Limit predator speed
-    float speed = std::sqrt(predator.dx * predator.dx + predator.dy * predator.dy);
-    float predatorSpeedLimit = 3.0f; // Reduced from 10.0f to make predator much slower
-    if (speed > predatorSpeedLimit) {
-        predator.dx = (predator.dx / speed) * predatorSpeedLimit;
-        predator.dy = (predator.dy / speed) * predatorSpeedLimit;
+    // Every rule also runs on the worker pool, which must not change a single bit
+    for (auto& benchmark : benchmarks) {
+        benchmark.variants.insert(benchmark.variants.begin(), {"parallel", parallelRule(benchmark.reference), 0.0f});
     }
 
-    // Avoid other predators
-    const float minDistance = 30.0f;
-    for (const auto& otherPredator : predators) {
-        if (&otherPredator != &predator) {
-            float dist = distance(otherPredator, predator);
-            if (dist < minDistance) {
-                float avoidFactor = 0.1f;
-                predator.dx += (predator.x - otherPredator.x) * avoidFactor;
-                predator.dy += (predator.y - otherPredator.y) * avoidFactor;
+    // Time a kernel by running it on fresh copies of the scene for at least minTimeMs
+    auto timeKernel = [&](const RuleKernel& kernel, std::vector<Boid>& output) {
+        double totalMs = 0;
+        int runs = 0;
+        while (totalMs < minTimeMs || runs < 3) {
+            output = scene;
+            auto start = std::chrono::steady_clock::now();
+            kernel(output, snapshot, predators);
+            totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            runs++;
+        }
+        return totalMs * 1e6 / runs / std::max<size_t>(scene.size(), 1);
+    };
+
+    bool allPassed = true;
+    printf("%d boids, %d predators, %d threads\n", NUM_BOIDS, numPredators, NUM_THREADS);
+    printf("%-18s %-16s %14s %12s %12s\n", "rule", "variant", "ns/boid", "max error", "check");
+    for (const auto& benchmark : benchmarks) {
+        std::vector<Boid> expected, actual;
+        double referenceNs = timeKernel(serialRule(benchmark.reference), expected);
+        printf("%-18s %-16s %14.2f %12s %12s\n", benchmark.rule, "scalar", referenceNs, "-", "reference");
+
+        for (const auto& variant : benchmark.variants) {
+            double variantNs = timeKernel(variant.kernel, actual);
+            float maxError = 0;
+            for (size_t i = 0; i < expected.size(); i++) {
+                maxError = std::max({maxError, std::fabs(expected[i].dx - actual[i].dx), std::fabs(expected[i].dy - actual[i].dy)});
             }
+            bool passed = maxError <= variant.tolerance;
+            allPassed &= passed;
+            printf("%-18s %-16s %14.2f %12.3g %12s\n", benchmark.rule, variant.name, variantNs, maxError,
+                   passed ? "ok" : "MISMATCH");
         }
     }
+    return allPassed;
+}
 
-    // Update predator position
-    predator.x += predator.dx;
-    predator.y += predator.dy;
+// A seeded scene for the golden trajectory checks
+struct GoldenScene {
+    uint64_t seed;
+    int boids, predators;
+    int steps;
+};
 
-    // Keep predator within screen bounds
-    if (predator.x < 0) {
-        predator.x = 0;
-        predator.dx *= -1;
-    } else if (predator.x > SCREEN_WIDTH) {
-        predator.x = SCREEN_WIDTH;
-        predator.dx *= -1;
-    }
-    if (predator.y < 0) {
-        predator.y = 0;
-        predator.dy *= -1;
-    } else if (predator.y > SCREEN_HEIGHT) {
-        predator.y = SCREEN_HEIGHT;
-        predator.dy *= -1;
+// A way of stepping the simulation that is checked against the scalar reference. The first
+// exactSteps steps must stay within maxError of it (chaos amplifies any rounding
+// difference after that), and the whole run must match it statistically.
+struct GoldenBackend {
+    const char* name;
+    SimulationMode mode;
+    NeighborBackend backend;
+    bool threaded;
+    int exactSteps;
+    float maxError;
+};
+
+// The predator scenes need enough boids for their statistics to mean something: with 400
+// boids and 3 predators, float and fixed point measured up to 0.15 apart in polarization
+// over 8 seeds, with 1000 boids at most 0.09
+const GoldenScene goldenScenes[] = {
+    {1, 100, 0, 200},
+    {2, 1000, 3, 200},
+    {3, 1000, 10, 100}
+};
+
+const uint32_t GOLDEN_MAGIC = 0x444c4742; // "BGLD"
+const uint32_t GOLDEN_VERSION = 2;
+
+// Golden files are little-endian with every field written on its own, so they read the
+// same on any machine and compiler
+void writeLittleEndian(std::ostream& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+uint64_t readLittleEndian(std::istream& in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(static_cast<uint8_t>(in.get())) << (i * 8);
+    return value;
+}
+
+// Run a scene with the given settings and return its boids' positions and velocities after
+// every step, as x, y, dx, dy per boid, and optionally the checksum of every step
+std::vector<std::vector<float>> runGoldenScene(const GoldenScene& scene, SimulationMode mode, NeighborBackend backend,
+                                               int threads, std::vector<FlockStats>* stats,
+                                               std::vector<uint64_t>* checksums = nullptr) {
+    WorkerPool pool;
+    startWorkers(pool, threads);
+    World golden;
+    golden.params.mode = mode;
+    golden.params.backend = backend;
+    golden.params.trailLength = world.params.trailLength;
+    golden.seed = scene.seed;
+    golden.workers = &pool;
+    initBoids(golden, scene.boids);
+    initPredators(golden, scene.predators);
+    const Flock& boids = golden.boids;
+
+    std::vector<std::vector<float>> trajectory(scene.steps);
+    for (int step = 0; step < scene.steps; step++) {
+        stepSimulation(golden);
+        trajectory[step].reserve(boids.size() * 4);
+        for (size_t i = 0; i < boids.size(); i++) {
+            trajectory[step].insert(trajectory[step].end(), {boids.x[i], boids.y[i], boids.dx[i], boids.dy[i]});
+        }
+        if (stats && step >= scene.steps / 2) stats->push_back(computeFlockStats(boids));
+        if (checksums) checksums->push_back(simulationChecksum(boids, golden.predators));
     }
+    stopWorkers(pool);
+    return trajectory;
 }
 
-void drawBoid(Tigr* screen, const Boid& boid) {
-    // Draw the boid as a solid rectangle
-    float width = SIZE * 3; // Width of the rectangle (3:1 ratio)
-    float height = SIZE; // Height of the rectangle (3:1 ratio)
-    
-    // Calculate the rotation angle
-    float angle = std::atan2(boid.dy, boid.dx);
-    
-    // Calculate the corners of the rotated rectangle
-    float cos_angle = std::cos(angle);
-    float sin_angle = std::sin(angle);
-    float corners[4][2] = {
-        {-width/2, -height/2},
-        {width/2, -height/2},
-        {width/2, height/2},
-        {-width/2, height/2}
+// Thread counts the per-step checksums must not depend on, whatever the machine's core
+// count: one, a few, an odd count that splits the chunks unevenly, and more threads than
+// most scenes have chunks
+const int goldenThreadCounts[] = {1, 2, 7, 64};
+
+// Run a scene at every golden thread count with float brute force, float grid and fixed
+// point (both backends), and check that each step's checksum is the same as the reference
+// backend's with one thread. Fixed-point sums are integers, so its grid must match its
+// brute force exactly too.
+bool checkThreadCounts(const GoldenScene& scene) {
+    struct ThreadCheck {
+        const char* name;
+        SimulationMode mode;
+        NeighborBackend backend;
+        NeighborBackend reference;
     };
-    
-    for (int i = 0; i < 4; i++) {
-        float x = corners[i][0];
-        float y = corners[i][1];
-        corners[i][0] = x * cos_angle - y * sin_angle + boid.x;
-        corners[i][1] = x * sin_angle + y * cos_angle + boid.y;
-    }
-    
-    // Draw the solid rotated rectangle
-    for (int y = static_cast<int>(boid.y - height); y <= static_cast<int>(boid.y + height); y++) {
-        for (int x = static_cast<int>(boid.x - width); x <= static_cast<int>(boid.x + width); x++) {
-            float local_x = (x - boid.x) * cos_angle + (y - boid.y) * sin_angle;
-            float local_y = -(x - boid.x) * sin_angle + (y - boid.y) * cos_angle;
-            if (local_x >= -width/2 && local_x <= width/2 && local_y >= -height/2 && local_y <= height/2) {
-                tigrPlot(screen, x, y, boid.color);
+    const ThreadCheck checks[] = {
+        {"brute", MODE_FLOAT, BACKEND_BRUTE_FORCE, BACKEND_BRUTE_FORCE},
+        {"grid", MODE_FLOAT, BACKEND_GRID, BACKEND_GRID},
+        {"fixed", MODE_FIXED, BACKEND_BRUTE_FORCE, BACKEND_BRUTE_FORCE},
+        {"fixed grid", MODE_FIXED, BACKEND_GRID, BACKEND_BRUTE_FORCE}
+    };
+
+    bool allPassed = true;
+    for (const auto& check : checks) {
+        std::vector<uint64_t> single;
+        runGoldenScene(scene, check.mode, check.reference, 1, nullptr, &single);
+        for (int threads : goldenThreadCounts) {
+            if (threads == 1 && check.backend == check.reference) continue;
+            std::vector<uint64_t> checksums;
+            runGoldenScene(scene, check.mode, check.backend, threads, nullptr, &checksums);
+            int firstBadStep = -1;
+            for (int step = 0; step < scene.steps && firstBadStep < 0; step++) {
+                if (checksums[step] != single[step]) firstBadStep = step;
             }
+            allPassed &= firstBadStep < 0;
+
+            char name[40], badStepText[32] = "-";
+            snprintf(name, sizeof(name), "%s, %d threads", check.name, threads);
+            if (firstBadStep >= 0) snprintf(badStepText, sizeof(badStepText), "%d", firstBadStep);
+            printf("%-6llu %-22s %12s %14s %8s\n", static_cast<unsigned long long>(scene.seed), name,
+                   firstBadStep < 0 ? "0" : "-", badStepText, "-");
         }
     }
+    return allPassed;
+}
 
-    // Draw trail
-    size_t trailSize = boid.history.size();
-    for (size_t i = 1; i < trailSize; ++i) {
-        TPixel trailColor = boid.color;
-        trailColor.a = static_cast<unsigned char>(175 * (i / static_cast<float>(trailSize)));
-        tigrLine(screen, 
-                 static_cast<int>(boid.history[i-1].first), static_cast<int>(boid.history[i-1].second),
-                 static_cast<int>(boid.history[i].first), static_cast<int>(boid.history[i].second),
-                 trailColor);
+FlockStats averageFlockStats(const std::vector<FlockStats>& samples) {
+    FlockStats average = {0, 0, 0};
+    for (const auto& stats : samples) {
+        average.polarization += stats.polarization / samples.size();
+        average.meanSpeed += stats.meanSpeed / samples.size();
+        average.meanNeighborDistance += stats.meanNeighborDistance / samples.size();
     }
+    return average;
 }
 
-void drawPredator(Tigr* screen, const Predator& predator) {
-    // Draw the predator as a rectangle with 3:1 ratio
-    float width = SIZE * 2 * 3; // Width of the rectangle (3:1 ratio, doubled from SIZE)
-    float height = SIZE * 2; // Height of the rectangle (3:1 ratio, doubled from SIZE)
-    
-    // Calculate the rotation angle
-    float angle = std::atan2(predator.dy, predator.dx);
-    
-    // Calculate the corners of the rotated rectangle
-    float cos_angle = std::cos(angle);
-    float sin_angle = std::sin(angle);
-    float corners[4][2] = {
-        {-width/2, -height/2},
-        {width/2, -height/2},
-        {width/2, height/2},
-        {-width/2, height/2}
-    };
-    
-    for (int i = 0; i < 4; i++) {
-        float x = corners[i][0];
-        float y = corners[i][1];
-        corners[i][0] = x * cos_angle - y * sin_angle + predator.x;
-        corners[i][1] = x * sin_angle + y * cos_angle + predator.y;
-    }
-    
-    // Draw the solid rotated rectangle
-    for (int y = static_cast<int>(predator.y - height); y <= static_cast<int>(predator.y + height); y++) {
-        for (int x = static_cast<int>(predator.x - width); x <= static_cast<int>(predator.x + width); x++) {
-            float local_x = (x - predator.x) * cos_angle + (y - predator.y) * sin_angle;
-            float local_y = -(x - predator.x) * sin_angle + (y - predator.y) * cos_angle;
-            if (local_x >= -width/2 && local_x <= width/2 && local_y >= -height/2 && local_y <= height/2) {
-                tigrPlot(screen, x, y, predator.color);
-            }
+// Record the scalar reference (float, brute force, one thread) for every golden scene, as
+// the checksum of each step's state
+bool recordGoldenTrajectories(const std::string& fileName) {
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file) return false;
+
+    writeLittleEndian(file, GOLDEN_MAGIC, 4);
+    writeLittleEndian(file, GOLDEN_VERSION, 4);
+    writeLittleEndian(file, std::size(goldenScenes), 4);
+    for (const auto& scene : goldenScenes) {
+        std::vector<uint64_t> checksums;
+        runGoldenScene(scene, MODE_FLOAT, BACKEND_BRUTE_FORCE, 1, nullptr, &checksums);
+        writeLittleEndian(file, scene.seed, 8);
+        writeLittleEndian(file, static_cast<uint32_t>(scene.boids), 4);
+        writeLittleEndian(file, static_cast<uint32_t>(scene.predators), 4);
+        writeLittleEndian(file, static_cast<uint32_t>(scene.steps), 4);
+        for (uint64_t checksum : checksums) {
+            writeLittleEndian(file, checksum, 8);
         }
+        printf("recorded seed %llu: %d boids, %d predators, %d steps\n",
+               static_cast<unsigned long long>(scene.seed), scene.boids, scene.predators, scene.steps);
     }
+    return static_cast<bool>(file);
 }
 
-void drawSlider(Tigr* screen, Slider& slider) {
-    // Draw slider background
-    tigrFillRect(screen, slider.x, slider.y, slider.width, slider.height, tigrRGB(50, 50, 50));
-    
-    // Draw slider handle
+// Check that the scalar reference still reproduces the recorded checksums bit for bit,
+// then compare every other backend against its trajectories, and every backend against
+// itself at several thread counts
+bool checkGoldenTrajectories(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    uint32_t magic = static_cast<uint32_t>(readLittleEndian(file, 4));
+    uint32_t version = static_cast<uint32_t>(readLittleEndian(file, 4));
+    uint32_t numScenes = static_cast<uint32_t>(readLittleEndian(file, 4));
+    if (!file || magic != GOLDEN_MAGIC || version != GOLDEN_VERSION) {
+        std::cerr << "Not a golden trajectory file: " << fileName << std::endl;
+        return false;
+    }
+
+    const GoldenBackend backends[] = {
+        {"brute, threaded", MODE_FLOAT, BACKEND_BRUTE_FORCE, true, INT32_MAX, 0.0f},
+        {"grid", MODE_FLOAT, BACKEND_GRID, false, 15, 0.01f},
+        {"grid, threaded", MODE_FLOAT, BACKEND_GRID, true, 15, 0.01f},
+        {"fixed, threaded", MODE_FIXED, BACKEND_BRUTE_FORCE, true, 0, 0.0f}
+    };
+
+    bool allPassed = true;
+    printf("%-6s %-22s %12s %14s %8s\n", "seed", "backend", "max error", "first bad step", "stats");
+    for (uint32_t s = 0; s < numScenes; s++) {
+        GoldenScene scene;
+        scene.seed = readLittleEndian(file, 8);
+        scene.boids = static_cast<int>(readLittleEndian(file, 4));
+        scene.predators = static_cast<int>(readLittleEndian(file, 4));
+        scene.steps = static_cast<int>(readLittleEndian(file, 4));
+        std::vector<uint64_t> recorded(file ? scene.steps : 0);
+        for (auto& checksum : recorded) {
+            checksum = readLittleEndian(file, 8);
+        }
+        if (!file) {
+            std::cerr << "Truncated golden trajectory file: " << fileName << std::endl;
+            return false;
+        }
+
+        // The other backends are measured against a fresh reference run, which is the
+        // recording itself whenever the checksums match
+        std::vector<FlockStats> referenceSamples;
+        std::vector<uint64_t> checksums;
+        auto reference = runGoldenScene(scene, MODE_FLOAT, BACKEND_BRUTE_FORCE, 1, &referenceSamples, &checksums);
+        bool referenceMatches = checksums == recorded;
+        allPassed &= referenceMatches;
+        printf("%-6llu %-22s %12s %14s %8s\n", static_cast<unsigned long long>(scene.seed), "scalar",
+               referenceMatches ? "0" : "-", referenceMatches ? "-" : "changed", "-");
+        FlockStats referenceStats = averageFlockStats(referenceSamples);
+
+        for (const auto& backend : backends) {
+            std::vector<FlockStats> samples;
+            auto trajectory = runGoldenScene(scene, backend.mode, backend.backend, backend.threaded ? NUM_THREADS : 1, &samples);
+
+            float maxError = 0;
+            int firstBadStep = -1;
+            for (int step = 0; step < std::min(scene.steps, backend.exactSteps); step++) {
+                float stepError = 0;
+                for (size_t i = 0; i < reference[step].size(); i++) {
+                    stepError = std::max(stepError, std::fabs(reference[step][i] - trajectory[step][i]));
+                }
+                maxError = std::max(maxError, stepError);
+                if (stepError > backend.maxError && firstBadStep < 0) firstBadStep = step;
+            }
+            bool statsAgree = flockStatsAgree(referenceStats, averageFlockStats(samples));
+            allPassed &= firstBadStep < 0 && statsAgree;
+
+            char errorText[32] = "-", badStepText[32] = "-";
+            if (backend.exactSteps > 0) snprintf(errorText, sizeof(errorText), "%.3g", maxError);
+            if (firstBadStep >= 0) snprintf(badStepText, sizeof(badStepText), "%d", firstBadStep);
+            printf("%-6llu %-22s %12s %14s %8s\n", static_cast<unsigned long long>(scene.seed), backend.name,
+                   errorText, badStepText, statsAgree ? "ok" : "FAIL");
+        }
+        allPassed &= checkThreadCounts(scene);
+    }
+    printf("%s\n", allPassed ? "PASS" : "FAIL");
+    return allPassed;
+}
+
+const uint32_t SNAPSHOT_MAGIC = 0x504e5342; // "BSNP"
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint64_t SNAPSHOT_ALIGNMENT = 64;
+
+// Size in bytes of one snapshot section
+uint64_t snapshotSectionSize(const SnapshotHeader& header, int section) {
+    switch (section) {
+        case SNAPSHOT_BOID_ID: return header.numBoids * sizeof(uint32_t);
+        case SNAPSHOT_BOID_X: case SNAPSHOT_BOID_Y: case SNAPSHOT_BOID_DX: case SNAPSHOT_BOID_DY:
+            return header.numBoids * sizeof(float);
+        case SNAPSHOT_TRAIL_START: return (header.numBoids + 1) * sizeof(uint64_t);
+        case SNAPSHOT_TRAIL_X: case SNAPSHOT_TRAIL_Y: return header.numTrailPoints * sizeof(float);
+        case SNAPSHOT_PREDATOR_ID: return header.numPredators * sizeof(uint32_t);
+        case SNAPSHOT_PREDATOR_X: case SNAPSHOT_PREDATOR_Y: case SNAPSHOT_PREDATOR_DX: case SNAPSHOT_PREDATOR_DY:
+            return header.numPredators * sizeof(float);
+        case SNAPSHOT_FIXED: return header.numFixed * sizeof(FixedBoid);
+    }
+    return 0;
+}
+
+// An array of a snapshot laid out in memory at base
+template <typename T>
+T* snapshotArray(void* base, const SnapshotHeader& header, SnapshotSection section) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + header.offsets[section]);
+}
+
+template <typename T>
+const T* snapshotArray(const Snapshot& snapshot, SnapshotSection section) {
+    return snapshotArray<T>(snapshot.data, *snapshot.header, section);
+}
+
+// Fill in the header for the current run: its settings, its array sizes, and where each
+// array goes
+void describeSnapshot(SnapshotHeader& header, const Flock& boids, const Flock& predators) {
+    header = SnapshotHeader();
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.seed = world.seed;
+    header.step = world.step;
+    header.nextBoidId = world.nextBoidId;
+    header.nextPredatorId = world.nextPredatorId;
+    header.mode = world.params.mode;
+    header.backend = world.params.backend;
+    header.worldWidth = world.params.width;
+    header.worldHeight = world.params.height;
+    header.windTime = world.wind.time;
+    header.centering = world.params.centeringFactor;
+    header.avoid = world.params.avoidFactor;
+    header.matching = world.params.matchingFactor;
+    header.speedLimit = world.params.speedLimit;
+    header.trailLength = world.params.trailLength;
+    header.hue = HUE;
+    header.margin = world.params.margin;
+    header.turn = world.params.turnFactor;
+    header.size = SIZE;
+    header.numBoids = boids.size();
+    header.numPredators = predators.size();
+    for (size_t i = 0; i < boids.size(); i++) {
+        header.numTrailPoints += boids.trailCount[i];
+    }
+    bool fixedInStep = world.fixedBoids.size() == boids.size() && world.fixedPredators.size() == predators.size();
+    header.numFixed = world.params.mode == MODE_FIXED && fixedInStep ? boids.size() + predators.size() : 0;
+
+    uint64_t offset = sizeof(SnapshotHeader);
+    for (int section = 0; section < SNAPSHOT_SECTIONS; section++) {
+        offset = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        header.offsets[section] = offset;
+        offset += snapshotSectionSize(header, section);
+    }
+    header.fileSize = offset;
+}
+
+// Lay the header and every array out at base, which must hold header.fileSize bytes.
+// Boids are split across the worker pool, each writing its own slice of every array.
+void fillSnapshot(void* base, const SnapshotHeader& header, const Flock& boids, const Flock& predators) {
+    memcpy(base, &header, sizeof(header));
+    uint64_t* trailStart = snapshotArray<uint64_t>(base, header, SNAPSHOT_TRAIL_START);
+    trailStart[0] = 0;
+    for (size_t i = 0; i < boids.size(); i++) {
+        trailStart[i + 1] = trailStart[i] + boids.trailCount[i];
+    }
+
+    uint32_t* id = snapshotArray<uint32_t>(base, header, SNAPSHOT_BOID_ID);
+    float* x = snapshotArray<float>(base, header, SNAPSHOT_BOID_X);
+    float* y = snapshotArray<float>(base, header, SNAPSHOT_BOID_Y);
+    float* dx = snapshotArray<float>(base, header, SNAPSHOT_BOID_DX);
+    float* dy = snapshotArray<float>(base, header, SNAPSHOT_BOID_DY);
+    float* trailX = snapshotArray<float>(base, header, SNAPSHOT_TRAIL_X);
+    float* trailY = snapshotArray<float>(base, header, SNAPSHOT_TRAIL_Y);
+    parallelFor(workers, boids.size(), 4096, [&](size_t begin, size_t end, int) {
+        std::copy(boids.id.begin() + begin, boids.id.begin() + end, id + begin);
+        std::copy(boids.x.begin() + begin, boids.x.begin() + end, x + begin);
+        std::copy(boids.y.begin() + begin, boids.y.begin() + end, y + begin);
+        std::copy(boids.dx.begin() + begin, boids.dx.begin() + end, dx + begin);
+        std::copy(boids.dy.begin() + begin, boids.dy.begin() + end, dy + begin);
+        for (size_t i = begin; i < end; i++) {
+            for (size_t p = 0; p < boids.trailCount[i]; p++) {
+                trailX[trailStart[i] + p] = boids.trailX[trailPoint(boids, i, p)];
+                trailY[trailStart[i] + p] = boids.trailY[trailPoint(boids, i, p)];
+            }
+        }
+    });
+
+    uint32_t* predatorId = snapshotArray<uint32_t>(base, header, SNAPSHOT_PREDATOR_ID);
+    float* predatorX = snapshotArray<float>(base, header, SNAPSHOT_PREDATOR_X);
+    float* predatorY = snapshotArray<float>(base, header, SNAPSHOT_PREDATOR_Y);
+    float* predatorDx = snapshotArray<float>(base, header, SNAPSHOT_PREDATOR_DX);
+    float* predatorDy = snapshotArray<float>(base, header, SNAPSHOT_PREDATOR_DY);
+    std::copy(predators.id.begin(), predators.id.end(), predatorId);
+    std::copy(predators.x.begin(), predators.x.end(), predatorX);
+    std::copy(predators.y.begin(), predators.y.end(), predatorY);
+    std::copy(predators.dx.begin(), predators.dx.end(), predatorDx);
+    std::copy(predators.dy.begin(), predators.dy.end(), predatorDy);
+
+    if (header.numFixed > 0) {
+        FixedBoid* fixed = snapshotArray<FixedBoid>(base, header, SNAPSHOT_FIXED);
+        memcpy(fixed, world.fixedBoids.data(), header.numBoids * sizeof(FixedBoid));
+        memcpy(fixed + header.numBoids, world.fixedPredators.data(), header.numPredators * sizeof(FixedBoid));
+    }
+}
+
+#ifndef _WIN32
+// Write the whole simulation state to a snapshot file. The file is sized up front and
+// mapped, so the arrays are written straight into the page cache in parallel.
+bool writeSnapshot(const std::string& fileName, const Flock& boids, const Flock& predators) {
+    SnapshotHeader header;
+    describeSnapshot(header, boids, predators);
+
+    int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    if (ftruncate(fd, static_cast<off_t>(header.fileSize)) != 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    fillSnapshot(data, header, boids, predators);
+    munmap(data, header.fileSize);
+    return true;
+}
+
+// Map a snapshot file read-only and check that its header and arrays fit in it. The
+// arrays are used where they lie; nothing is parsed.
+bool mapSnapshot(const std::string& fileName, Snapshot& snapshot) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(data);
+    bool valid = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+                 header->fileSize == static_cast<uint64_t>(info.st_size) &&
+                 (header->numFixed == 0 || header->numFixed == header->numBoids + header->numPredators);
+    for (int section = 0; valid && section < SNAPSHOT_SECTIONS; section++) {
+        uint64_t size = snapshotSectionSize(*header, section);
+        valid = header->offsets[section] % SNAPSHOT_ALIGNMENT == 0 && header->offsets[section] <= header->fileSize &&
+                size <= header->fileSize - header->offsets[section];
+    }
+    if (valid) {
+        const uint64_t* trailStart = reinterpret_cast<const uint64_t*>(static_cast<const uint8_t*>(data) +
+                                                                       header->offsets[SNAPSHOT_TRAIL_START]);
+        valid = trailStart[0] == 0 && trailStart[header->numBoids] == header->numTrailPoints;
+    }
+    if (!valid) {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    unmapSnapshot(snapshot);
+    snapshot.header = header;
+    snapshot.data = data;
+    snapshot.size = info.st_size;
+    return true;
+}
+
+void unmapSnapshot(Snapshot& snapshot) {
+    if (snapshot.data) munmap(snapshot.data, snapshot.size);
+    snapshot = Snapshot();
+}
+#else
+bool writeSnapshot(const std::string&, const Flock&, const Flock&) {
+    std::cerr << "Snapshots are not supported on this platform" << std::endl;
+    return false;
+}
+
+bool mapSnapshot(const std::string&, Snapshot&) {
+    std::cerr << "Snapshots are not supported on this platform" << std::endl;
+    return false;
+}
+
+void unmapSnapshot(Snapshot& snapshot) {
+    snapshot = Snapshot();
+}
+#endif
+
+// Resume the run a snapshot was taken from: settings, random number state and step
+// counter, then the flock and predators
+void restoreSnapshot(const Snapshot& snapshot, Flock& boids, Flock& predators) {
+    const SnapshotHeader& header = *snapshot.header;
+    world.seed = header.seed;
+    world.step = header.step;
+    world.nextBoidId = header.nextBoidId;
+    world.nextPredatorId = header.nextPredatorId;
+    world.params.mode = header.mode == MODE_FIXED ? MODE_FIXED : MODE_FLOAT;
+    world.params.backend = header.backend == BACKEND_BRUTE_FORCE ? BACKEND_BRUTE_FORCE : BACKEND_GRID;
+    world.params.width = header.worldWidth;
+    world.params.height = header.worldHeight;
+    world.wind.time = header.windTime;
+    world.params.centeringFactor = header.centering;
+    world.params.avoidFactor = header.avoid;
+    world.params.matchingFactor = header.matching;
+    world.params.speedLimit = header.speedLimit;
+    world.params.trailLength = header.trailLength;
+    HUE = header.hue;
+    world.params.margin = header.margin;
+    world.params.turnFactor = header.turn;
+    SIZE = header.size;
+
+    const uint32_t* id = snapshotArray<uint32_t>(snapshot, SNAPSHOT_BOID_ID);
+    const float* x = snapshotArray<float>(snapshot, SNAPSHOT_BOID_X);
+    const float* y = snapshotArray<float>(snapshot, SNAPSHOT_BOID_Y);
+    const float* dx = snapshotArray<float>(snapshot, SNAPSHOT_BOID_DX);
+    const float* dy = snapshotArray<float>(snapshot, SNAPSHOT_BOID_DY);
+    const uint64_t* trailStart = snapshotArray<uint64_t>(snapshot, SNAPSHOT_TRAIL_START);
+    const float* trailX = snapshotArray<float>(snapshot, SNAPSHOT_TRAIL_X);
+    const float* trailY = snapshotArray<float>(snapshot, SNAPSHOT_TRAIL_Y);
+    // Trails longer than the trail length keep their newest points, as after a step
+    size_t capacity = static_cast<size_t>(std::max(0.0f, world.params.trailLength));
+    resizeFlock(boids, 0);
+    setTrailCapacity(boids, capacity);
+    resizeFlock(boids, header.numBoids);
+    parallelFor(workers, boids.size(), 4096, [&](size_t begin, size_t end, int) {
+        std::copy(id + begin, id + end, boids.id.begin() + begin);
+        std::copy(x + begin, x + end, boids.x.begin() + begin);
+        std::copy(y + begin, y + end, boids.y.begin() + begin);
+        std::copy(dx + begin, dx + end, boids.dx.begin() + begin);
+        std::copy(dy + begin, dy + end, boids.dy.begin() + begin);
+        for (size_t i = begin; i < end; i++) {
+            // A corrupt offset gives an empty trail rather than a read out of bounds
+            uint64_t last = std::min(trailStart[i + 1], header.numTrailPoints);
+            uint64_t first = std::clamp(trailStart[i], last - std::min<uint64_t>(last, capacity), last);
+            boids.trailCount[i] = static_cast<uint32_t>(last - first);
+            std::copy(trailX + first, trailX + last, boids.trailX.begin() + i * capacity);
+            std::copy(trailY + first, trailY + last, boids.trailY.begin() + i * capacity);
+        }
+    });
+
+    const uint32_t* predatorId = snapshotArray<uint32_t>(snapshot, SNAPSHOT_PREDATOR_ID);
+    const float* predatorX = snapshotArray<float>(snapshot, SNAPSHOT_PREDATOR_X);
+    const float* predatorY = snapshotArray<float>(snapshot, SNAPSHOT_PREDATOR_Y);
+    const float* predatorDx = snapshotArray<float>(snapshot, SNAPSHOT_PREDATOR_DX);
+    const float* predatorDy = snapshotArray<float>(snapshot, SNAPSHOT_PREDATOR_DY);
+    predators.id.assign(predatorId, predatorId + header.numPredators);
+    predators.x.assign(predatorX, predatorX + header.numPredators);
+    predators.y.assign(predatorY, predatorY + header.numPredators);
+    predators.dx.assign(predatorDx, predatorDx + header.numPredators);
+    predators.dy.assign(predatorDy, predatorDy + header.numPredators);
+    resizeFlock(predators, header.numPredators);
+
+    const FixedBoid* fixed = snapshotArray<FixedBoid>(snapshot, SNAPSHOT_FIXED);
+    size_t fixedBoids = header.numFixed > 0 ? header.numBoids : 0;
+    world.fixedBoids.assign(fixed, fixed + fixedBoids);
+    world.fixedPredators.assign(fixed + fixedBoids, fixed + header.numFixed);
+}
+
+// Write the snapshot in the spare buffer whenever one is handed over. It goes to a
+// temporary file first, so the checkpoint on disk is always a whole one.
+void checkpointWriter(Checkpointer& checkpointer) {
+    setTraceThreadName("checkpoint");
+    std::unique_lock<std::mutex> lock(checkpointer.mutex);
+    while (true) {
+        checkpointer.wake.wait(lock, [&]() { return checkpointer.quit || checkpointer.pending; });
+        if (!checkpointer.pending) return;
+        lock.unlock();
+
+        uint64_t traceStart = traceBegin();
+        auto start = std::chrono::steady_clock::now();
+        std::string tempFile = CHECKPOINT_FILE + ".tmp";
+        std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(checkpointer.buffer.get()), checkpointer.size);
+        out.close();
+        bool written = !out.fail();
+#ifdef _WIN32
+        // Windows won't rename over an existing file
+        if (written) std::remove(CHECKPOINT_FILE.c_str());
+#endif
+        written = written && rename(tempFile.c_str(), CHECKPOINT_FILE.c_str()) == 0;
+        double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        traceEnd("checkpoint write", traceStart);
+        if (written) {
+            printf("checkpoint at step %u: %.1f MB, %.2f ms stall, written in %.1f ms\n", checkpointer.step,
+                   checkpointer.size / 1048576.0, checkpointer.copyMs, writeMs);
+        } else {
+            std::cerr << "Could not write checkpoint " << CHECKPOINT_FILE << std::endl;
+        }
+
+        lock.lock();
+        checkpointer.pending = false;
+        checkpointer.idle.notify_all();
+    }
+}
+
+// Copy the state into the spare buffer and hand it to the writer thread. Stepping only
+// waits for the copy; if the last checkpoint is still being written, this one is
+// dropped rather than waited for. The copy time is kept in world.phaseTimes.checkpoint.
+bool checkpoint(Checkpointer& checkpointer, const Flock& boids, const Flock& predators) {
+    {
+        std::lock_guard<std::mutex> lock(checkpointer.mutex);
+        if (checkpointer.pending) {
+            checkpointer.skipped++;
+            return false;
+        }
+    }
+    if (!checkpointer.thread.joinable()) {
+        checkpointer.quit = false;
+        checkpointer.thread = std::thread(checkpointWriter, std::ref(checkpointer));
+    }
+
+    uint64_t traceStart = traceBegin();
+    auto start = std::chrono::steady_clock::now();
+    SnapshotHeader header;
+    describeSnapshot(header, boids, predators);
+    if (header.fileSize > checkpointer.capacity) {
+        checkpointer.buffer.reset(new uint8_t[header.fileSize]);
+        checkpointer.capacity = header.fileSize;
+    }
+    fillSnapshot(checkpointer.buffer.get(), header, boids, predators);
+    world.phaseTimes.checkpoint = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    traceEnd("checkpoint copy", traceStart);
+
+    {
+        std::lock_guard<std::mutex> lock(checkpointer.mutex);
+        checkpointer.size = header.fileSize;
+        checkpointer.step = world.step;
+        checkpointer.copyMs = world.phaseTimes.checkpoint;
+        checkpointer.pending = true;
+    }
+    checkpointer.wake.notify_one();
+    return true;
+}
+
+// Checkpoint every CHECKPOINT_INTERVAL steps
+void autoCheckpoint(Checkpointer& checkpointer, const Flock& boids, const Flock& predators) {
+    if (CHECKPOINT_INTERVAL > 0 && world.step % CHECKPOINT_INTERVAL == 0) {
+        checkpoint(checkpointer, boids, predators);
+    }
+}
+
+// Let the writer finish the checkpoint it has, then stop it
+void stopCheckpointer(Checkpointer& checkpointer) {
+    if (!checkpointer.thread.joinable()) return;
+    {
+        std::unique_lock<std::mutex> lock(checkpointer.mutex);
+        checkpointer.idle.wait(lock, [&]() { return !checkpointer.pending; });
+        checkpointer.quit = true;
+    }
+    checkpointer.wake.notify_one();
+    checkpointer.thread.join();
+    if (checkpointer.skipped > 0) {
+        printf("%d checkpoints skipped while the previous one was still being written\n", checkpointer.skipped);
+    }
+}
+
+const uint32_t RECORDING_MAGIC = 0x43455242; // "BREC"
+const uint32_t RECORDING_VERSION = 1;
+const size_t PACK_BLOCK = 64;
+
+// Copy the flock's ids, positions and velocities, and the predators, into a frame
+void captureFrame(RecordedFrame& frame, const Flock& boids, const Flock& predators) {
+    size_t numBoids = boids.size();
+    frame.step = world.step;
+    frame.ids.resize(numBoids);
+    frame.x.resize(numBoids);
+    frame.y.resize(numBoids);
+    frame.dx.resize(numBoids);
+    frame.dy.resize(numBoids);
+    parallelFor(workers, numBoids, 16384, [&](size_t begin, size_t end, int) {
+        std::copy(boids.id.begin() + begin, boids.id.begin() + end, frame.ids.begin() + begin);
+        std::copy(boids.x.begin() + begin, boids.x.begin() + end, frame.x.begin() + begin);
+        std::copy(boids.y.begin() + begin, boids.y.begin() + end, frame.y.begin() + begin);
+        std::copy(boids.dx.begin() + begin, boids.dx.begin() + end, frame.dx.begin() + begin);
+        std::copy(boids.dy.begin() + begin, boids.dy.begin() + end, frame.dy.begin() + begin);
+    });
+    frame.predators.clear();
+    for (size_t i = 0; i < predators.size(); i++) {
+        frame.predators.insert(frame.predators.end(), {predators.x[i], predators.y[i], predators.dx[i], predators.dy[i]});
+    }
+}
+
+// Append signed values in blocks of PACK_BLOCK: a byte with the bit width of the
+// block's largest zigzag-coded value, then every value packed at that width, LSB first.
+// Small residuals cost a few bits each, and an all-zero block costs one byte.
+void packColumn(const int32_t* values, size_t count, std::vector<uint8_t>& out) {
+    for (size_t block = 0; block < count; block += PACK_BLOCK) {
+        size_t n = std::min(PACK_BLOCK, count - block);
+        uint32_t zigzag[PACK_BLOCK];
+        uint32_t all = 0;
+        for (size_t i = 0; i < n; i++) {
+            int32_t value = values[block + i];
+            zigzag[i] = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+            all |= zigzag[i];
+        }
+        int width = all ? 32 - __builtin_clz(all) : 0;
+        out.push_back(static_cast<uint8_t>(width));
+
+        uint64_t bits = 0;
+        int used = 0;
+        for (size_t i = 0; i < n; i++) {
+            bits |= static_cast<uint64_t>(zigzag[i]) << used;
+            used += width;
+            while (used >= 8) {
+                out.push_back(static_cast<uint8_t>(bits));
+                bits >>= 8;
+                used -= 8;
+            }
+        }
+        if (used > 0) out.push_back(static_cast<uint8_t>(bits));
+    }
+}
+
+// Read back count values written by packColumn. Returns the end of the column, or
+// nullptr if it runs past end.
+const uint8_t* unpackColumn(const uint8_t* in, const uint8_t* end, int32_t* values, size_t count) {
+    for (size_t block = 0; block < count; block += PACK_BLOCK) {
+        size_t n = std::min(PACK_BLOCK, count - block);
+        if (in >= end) return nullptr;
+        int width = *in++;
+        if (width > 32 || static_cast<size_t>(end - in) < (n * width + 7) / 8) return nullptr;
+
+        uint32_t mask = width == 32 ? UINT32_MAX : (1u << width) - 1;
+        uint64_t bits = 0;
+        int have = 0;
+        for (size_t i = 0; i < n; i++) {
+            while (have < width) {
+                bits |= static_cast<uint64_t>(*in++) << have;
+                have += 8;
+            }
+            uint32_t zigzag = static_cast<uint32_t>(bits) & mask;
+            bits >>= width;
+            have -= width;
+            values[block + i] = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        }
+    }
+    return in;
+}
+
+int32_t quantize(float value, int32_t scale) {
+    return static_cast<int32_t>(std::lround(std::clamp(value * scale, -1e9f, 1e9f)));
+}
+
+// Where a boid at quantized position x lands after moving by quantized velocity dx
+int32_t predictPosition(const FrameCodec& codec, int32_t x, int32_t dx) {
+    return x + static_cast<int32_t>((static_cast<int64_t>(dx) * codec.positionScale + codec.velocityScale / 2) /
+                                    codec.velocityScale);
+}
+
+// Quantize a frame and append it to out. Velocities are coded as the change since the
+// previous frame, and positions as the error of moving the previous position by the new
+// velocity, which is nearly always under a quantization step. Keyframes code the values
+// themselves (and ids as the gap from the previous id), so decoding can start at any of
+// them. A frame that doesn't follow the codec's last one, or whose flock differs, is
+// always coded as a keyframe.
+void encodeFrame(FrameCodec& codec, const RecordedFrame& frame, bool keyframe, std::vector<uint8_t>& out) {
+    size_t numBoids = frame.ids.size();
+    keyframe = keyframe || !codec.valid || frame.step != codec.step + 1 || codec.ids != frame.ids;
+    FrameHeader header = {frame.step, static_cast<uint32_t>(numBoids), static_cast<uint32_t>(frame.predators.size() / 4),
+                          keyframe ? 1u : 0u, 0};
+    size_t headerAt = out.size();
+    out.resize(headerAt + sizeof(header));
+
+    std::vector<int32_t>& residual = codec.residual;
+    residual.resize(numBoids);
+    if (keyframe) {
+        codec.ids = frame.ids;
+        codec.x.assign(numBoids, 0);
+        codec.y.assign(numBoids, 0);
+        codec.dx.assign(numBoids, 0);
+        codec.dy.assign(numBoids, 0);
+        for (size_t i = 0; i < numBoids; i++) {
+            residual[i] = static_cast<int32_t>(frame.ids[i] - (i > 0 ? frame.ids[i - 1] : 0));
+        }
+        packColumn(residual.data(), numBoids, out);
+    }
+
+    // Velocities first, since the decoder needs them to predict positions
+    const std::vector<float>* velocities[2] = {&frame.dx, &frame.dy};
+    std::vector<int32_t>* codedVelocities[2] = {&codec.dx, &codec.dy};
+    for (int axis = 0; axis < 2; axis++) {
+        std::vector<int32_t>& coded = *codedVelocities[axis];
+        for (size_t i = 0; i < numBoids; i++) {
+            int32_t q = quantize((*velocities[axis])[i], codec.velocityScale);
+            residual[i] = keyframe ? q : q - coded[i];
+            coded[i] = q;
+        }
+        packColumn(residual.data(), numBoids, out);
+    }
+    const std::vector<float>* positions[2] = {&frame.x, &frame.y};
+    std::vector<int32_t>* codedPositions[2] = {&codec.x, &codec.y};
+    for (int axis = 0; axis < 2; axis++) {
+        std::vector<int32_t>& coded = *codedPositions[axis];
+        const std::vector<int32_t>& velocity = *codedVelocities[axis];
+        for (size_t i = 0; i < numBoids; i++) {
+            int32_t q = quantize((*positions[axis])[i], codec.positionScale);
+            residual[i] = keyframe ? q : q - predictPosition(codec, coded[i], velocity[i]);
+            coded[i] = q;
+        }
+        packColumn(residual.data(), numBoids, out);
+    }
+
+    size_t predatorAt = out.size();
+    out.resize(predatorAt + frame.predators.size() * sizeof(float));
+    if (!frame.predators.empty()) memcpy(&out[predatorAt], frame.predators.data(), frame.predators.size() * sizeof(float));
+
+    header.payloadBytes = out.size() - headerAt - sizeof(header);
+    memcpy(&out[headerAt], &header, sizeof(header));
+    codec.valid = true;
+    codec.step = frame.step;
+    codec.sinceKeyframe = keyframe ? 0 : codec.sinceKeyframe + 1;
+}
+
+// Decode the frame at data (header included) into frame. A delta frame needs the codec
+// to hold the frame before it; returns false if it doesn't, or if the data is corrupt.
+bool decodeFrame(FrameCodec& codec, const uint8_t* data, size_t size, RecordedFrame& frame) {
+    FrameHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.payloadBytes > size - sizeof(header)) return false;
+    const uint8_t* in = data + sizeof(header);
+    const uint8_t* end = in + header.payloadBytes;
+    size_t numBoids = header.numBoids;
+    bool keyframe = header.keyframe != 0;
+    if (!keyframe && (!codec.valid || header.step != codec.step + 1 || codec.ids.size() != numBoids)) return false;
+
+    std::vector<int32_t>& residual = codec.residual;
+    residual.resize(numBoids);
+    if (keyframe) {
+        if (!(in = unpackColumn(in, end, residual.data(), numBoids))) return false;
+        codec.ids.resize(numBoids);
+        for (size_t i = 0; i < numBoids; i++) {
+            codec.ids[i] = (i > 0 ? codec.ids[i - 1] : 0) + static_cast<uint32_t>(residual[i]);
+        }
+        codec.x.assign(numBoids, 0);
+        codec.y.assign(numBoids, 0);
+        codec.dx.assign(numBoids, 0);
+        codec.dy.assign(numBoids, 0);
+    }
+
+    std::vector<int32_t>* codedVelocities[2] = {&codec.dx, &codec.dy};
+    for (int axis = 0; axis < 2; axis++) {
+        if (!(in = unpackColumn(in, end, residual.data(), numBoids))) return false;
+        std::vector<int32_t>& coded = *codedVelocities[axis];
+        for (size_t i = 0; i < numBoids; i++) {
+            coded[i] = keyframe ? residual[i] : coded[i] + residual[i];
+        }
+    }
+    std::vector<int32_t>* codedPositions[2] = {&codec.x, &codec.y};
+    for (int axis = 0; axis < 2; axis++) {
+        if (!(in = unpackColumn(in, end, residual.data(), numBoids))) return false;
+        std::vector<int32_t>& coded = *codedPositions[axis];
+        const std::vector<int32_t>& velocity = *codedVelocities[axis];
+        for (size_t i = 0; i < numBoids; i++) {
+            coded[i] = keyframe ? residual[i] : predictPosition(codec, coded[i], velocity[i]) + residual[i];
+        }
+    }
+    if (static_cast<size_t>(end - in) != header.numPredators * 4 * sizeof(float)) return false;
+
+    frame.step = header.step;
+    frame.ids = codec.ids;
+    frame.x.resize(numBoids);
+    frame.y.resize(numBoids);
+    frame.dx.resize(numBoids);
+    frame.dy.resize(numBoids);
+    float positionStep = 1.0f / codec.positionScale, velocityStep = 1.0f / codec.velocityScale;
+    for (size_t i = 0; i < numBoids; i++) {
+        frame.x[i] = codec.x[i] * positionStep;
+        frame.y[i] = codec.y[i] * positionStep;
+        frame.dx[i] = codec.dx[i] * velocityStep;
+        frame.dy[i] = codec.dy[i] * velocityStep;
+    }
+    frame.predators.resize(header.numPredators * 4);
+    if (header.numPredators > 0) memcpy(frame.predators.data(), in, frame.predators.size() * sizeof(float));
+    codec.valid = true;
+    codec.step = header.step;
+    codec.sinceKeyframe = header.keyframe ? 0 : codec.sinceKeyframe + 1;
+    return true;
+}
+
+// Encode captured frames in order and append them to the recording. A gap in the
+// steps (a frame dropped because the ring was full) starts a new keyframe.
+void recorderThread(TrajectoryRecorder& recorder) {
+    setTraceThreadName("recorder");
+    std::unique_lock<std::mutex> lock(recorder.mutex);
+    while (true) {
+        recorder.wake.wait(lock, [&]() { return recorder.quit || recorder.tail < recorder.head; });
+        if (recorder.tail == recorder.head) return;
+        RecordedFrame& frame = recorder.ring[recorder.tail % recorder.ring.size()];
+        lock.unlock();
+
+        uint64_t traceStart = traceBegin();
+        recorder.encoded.clear();
+        encodeFrame(recorder.codec, frame, recorder.codec.sinceKeyframe + 1 >= RECORD_KEYFRAME_INTERVAL, recorder.encoded);
+        fwrite(recorder.encoded.data(), 1, recorder.encoded.size(), recorder.file);
+        recorder.bytes += recorder.encoded.size();
+        recorder.frames++;
+        recorder.boidSteps += frame.ids.size();
+        traceEnd("encode frame", traceStart);
+
+        lock.lock();
+        recorder.tail++;
+    }
+}
+
+// Open a recording and start its encoder thread
+bool startRecorder(TrajectoryRecorder& recorder, const std::string& fileName) {
+    recorder.file = fopen(fileName.c_str(), "wb");
+    if (!recorder.file) return false;
+    RecordingHeader header = {RECORDING_MAGIC, RECORDING_VERSION, world.params.width, world.params.height,
+                              recorder.codec.positionScale, recorder.codec.velocityScale, RECORD_KEYFRAME_INTERVAL, 0, world.seed};
+    fwrite(&header, sizeof(header), 1, recorder.file);
+    recorder.bytes = sizeof(header);
+    recorder.ring.resize(RECORD_RING_FRAMES);
+    recorder.thread = std::thread(recorderThread, std::ref(recorder));
+    return true;
+}
+
+// Capture the current step into the ring for the encoder. The simulation never waits
+// for it: when the ring is full the frame is dropped and counted.
+void recordFrame(TrajectoryRecorder& recorder, const Flock& boids, const Flock& predators) {
+    if (!recorder.file) return;
+    RecordedFrame* frame;
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        if (recorder.head - recorder.tail == recorder.ring.size()) {
+            recorder.dropped++;
+            return;
+        }
+        frame = &recorder.ring[recorder.head % recorder.ring.size()];
+    }
+    uint64_t traceStart = traceBegin();
+    captureFrame(*frame, boids, predators);
+    traceEnd("capture frame", traceStart);
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        recorder.head++;
+    }
+    recorder.wake.notify_one();
+}
+
+// Encode whatever is still in the ring, then close the recording
+void stopRecorder(TrajectoryRecorder& recorder) {
+    if (!recorder.file) return;
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        recorder.quit = true;
+    }
+    recorder.wake.notify_one();
+    recorder.thread.join();
+    fclose(recorder.file);
+    recorder.file = nullptr;
+    printf("recorded %llu frames (%llu dropped): %.1f MB, %.2f bytes per boid-step\n",
+           static_cast<unsigned long long>(recorder.frames), static_cast<unsigned long long>(recorder.dropped),
+           recorder.bytes / 1048576.0, recorder.boidSteps > 0 ? static_cast<double>(recorder.bytes) / recorder.boidSteps : 0.0);
+}
+
+// Decode frames ahead of playback until the ring is full. Frames are decoded in order
+// from wherever the last seek left off; a seek while a frame is being decoded throws
+// that frame away.
+void replayDecoder(ReplayPlayer& player) {
+    setTraceThreadName("replay decoder");
+    std::unique_lock<std::mutex> lock(player.mutex);
+    while (true) {
+        player.wake.wait(lock, [&]() {
+            return player.quit || (player.head - player.tail < player.ring.size() && player.nextFrame < player.frameOffsets.size());
+        });
+        if (player.quit) return;
+        size_t index = player.nextFrame++;
+        uint64_t generation = player.generation;
+        size_t slot = player.head % player.ring.size();
+        lock.unlock();
+
+        uint64_t traceStart = traceBegin();
+        uint64_t offset = player.frameOffsets[index];
+        bool decoded = decodeFrame(player.codec, player.data + offset, player.size - offset, player.ring[slot]);
+        traceEnd("decode frame", traceStart);
+
+        lock.lock();
+        if (generation != player.generation) continue;
+        if (!decoded) {
+            // Corrupt frame: play up to here
+            player.nextFrame = player.frameOffsets.size();
+            continue;
+        }
+        player.ringFrame[slot] = index;
+        player.head++;
+    }
+}
+
+#ifndef _WIN32
+// Map a recording, find where each frame starts by hopping from header to header, and
+// start decoding from the first frame. A truncated last frame (from a run that didn't
+// exit cleanly) is left out.
+bool openReplay(ReplayPlayer& player, const std::string& fileName) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(RecordingHeader)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    player.data = static_cast<const uint8_t*>(data);
+    player.size = info.st_size;
+    memcpy(&player.header, player.data, sizeof(player.header));
+    if (player.header.magic != RECORDING_MAGIC || player.header.version != RECORDING_VERSION ||
+        player.header.positionScale <= 0 || player.header.velocityScale <= 0) {
+        closeReplay(player);
+        return false;
+    }
+
+    uint64_t offset = sizeof(RecordingHeader);
+    FrameHeader frame;
+    while (player.size - offset >= sizeof(FrameHeader)) {
+        memcpy(&frame, player.data + offset, sizeof(frame));
+        if (frame.payloadBytes > player.size - offset - sizeof(FrameHeader)) break;
+        if (frame.keyframe) player.keyframes.push_back(player.frameOffsets.size());
+        player.frameOffsets.push_back(offset);
+        offset += sizeof(FrameHeader) + frame.payloadBytes;
+    }
+
+    player.codec.positionScale = player.header.positionScale;
+    player.codec.velocityScale = player.header.velocityScale;
+    player.ring.resize(REPLAY_LOOKAHEAD_FRAMES);
+    player.ringFrame.resize(REPLAY_LOOKAHEAD_FRAMES);
+    player.quit = false;
+    player.thread = std::thread(replayDecoder, std::ref(player));
+    return true;
+}
+
+void closeReplay(ReplayPlayer& player) {
+    if (player.thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(player.mutex);
+            player.quit = true;
+        }
+        player.wake.notify_one();
+        player.thread.join();
+    }
+    if (player.data) munmap(const_cast<uint8_t*>(player.data), player.size);
+    player.data = nullptr;
+    player.frameOffsets.clear();
+    player.keyframes.clear();
+}
+#else
+bool openReplay(ReplayPlayer&, const std::string&) {
+    std::cerr << "Replays are not supported on this platform" << std::endl;
+    return false;
+}
+
+void closeReplay(ReplayPlayer&) {}
+#endif
+
+size_t nearestKeyframe(const ReplayPlayer& player, size_t frame) {
+    if (player.keyframes.empty()) return 0;
+    auto after = std::lower_bound(player.keyframes.begin(), player.keyframes.end(), frame);
+    if (after == player.keyframes.end()) return player.keyframes.back();
+    if (after != player.keyframes.begin() && frame - *(after - 1) < *after - frame) return *(after - 1);
+    return *after;
+}
+
+// Restart decoding at the keyframe nearest a frame, dropping everything decoded ahead.
+// Returns the keyframe's index.
+size_t seekReplay(ReplayPlayer& player, size_t frame) {
+    size_t nearest = nearestKeyframe(player, frame);
+    {
+        std::lock_guard<std::mutex> lock(player.mutex);
+        player.nextFrame = nearest;
+        player.head = player.tail = 0;
+        player.generation++;
+    }
+    player.wake.notify_one();
+    return nearest;
+}
+
+// Take the next decoded frame if there is one, without waiting for it
+bool takeReplayFrame(ReplayPlayer& player, RecordedFrame& frame, size_t& index) {
+    {
+        std::lock_guard<std::mutex> lock(player.mutex);
+        if (player.tail == player.head) return false;
+        size_t slot = player.tail % player.ring.size();
+        std::swap(frame, player.ring[slot]);
+        index = player.ringFrame[slot];
+        player.tail++;
+    }
+    player.wake.notify_one();
+    return true;
+}
+
+// Turn a decoded frame into boids and predators for drawing. While frames follow one
+// another with the same flock, each boid's trail grows from its earlier positions; after
+// a seek or a change in the flock the trails start over.
+void applyReplayFrame(const RecordedFrame& frame, bool continues, Flock& boids, Flock& predators) {
+    size_t numBoids = frame.ids.size();
+    continues = continues && boids.size() == numBoids;
+    for (size_t i = 0; continues && i < numBoids; i++) {
+        continues = boids.id[i] == frame.ids[i];
+    }
+    resizeFlock(boids, numBoids);
+    setTrailCapacity(boids, static_cast<size_t>(std::max(0.0f, world.params.trailLength)));
+    if (!continues) clearTrails(boids);
+    parallelFor(workers, numBoids, 4096, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            boids.id[i] = frame.ids[i];
+            boids.x[i] = frame.x[i];
+            boids.y[i] = frame.y[i];
+            boids.dx[i] = frame.dx[i];
+            boids.dy[i] = frame.dy[i];
+            updateTrail(boids, i);
+        }
+    });
+
+    resizeFlock(predators, frame.predators.size() / 4);
+    for (size_t i = 0; i < predators.size(); i++) {
+        predators.id[i] = static_cast<uint32_t>(i);
+        predators.x[i] = frame.predators[i * 4];
+        predators.y[i] = frame.predators[i * 4 + 1];
+        predators.dx[i] = frame.predators[i * 4 + 2];
+        predators.dy[i] = frame.predators[i * 4 + 3];
+    }
+}
+
+// Progress bar along the bottom of the window, with a tick at every keyframe
+void drawTimeline(Tigr* screen, const ReplayPlayer& player, size_t frame) {
+    int y = screen->h - 14, width = screen->w - 20;
+    size_t numFrames = std::max<size_t>(1, player.frameOffsets.size());
+    tigrFillRect(screen, 10, y, width, 6, tigrRGBA(255, 255, 255, 60));
+    for (size_t keyframe : player.keyframes) {
+        tigrLine(screen, 10 + static_cast<int>(keyframe * width / numFrames), y - 2,
+                 10 + static_cast<int>(keyframe * width / numFrames), y + 8, tigrRGBA(255, 255, 255, 90));
+    }
+    tigrFillRect(screen, 10, y, static_cast<int>((frame + 1) * width / numFrames), 6, tigrRGB(255, 255, 255));
+}
+
+// Play a recording in the window without simulating: decoded frames go through the same
+// drawing as a live run. Space pauses, the arrow keys jump one (left/right) or ten
+// (down/up) keyframes, and clicking or dragging on the timeline seeks to the keyframe
+// nearest that point.
+int runReplay(const std::string& fileName) {
+    ReplayPlayer player;
+    if (!openReplay(player, fileName)) {
+        std::cerr << "Not a recording: " << fileName << std::endl;
+        return 1;
+    }
+    world.params.width = player.header.worldWidth;
+    world.params.height = player.header.worldHeight;
+    WORLD_FOLLOWS_WINDOW = false;
+    printf("%s: %zu frames, %zu keyframes\n", fileName.c_str(), player.frameOffsets.size(), player.keyframes.size());
+
+    Tigr* screen = tigrWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Boids Replay", 1);
+    fitCamera(screen->w, screen->h);
+    std::vector<Slider> sliders = createSliders();
+    Flock boids;
+    Flock predators;
+    RecordedFrame frame;
+    size_t shownFrame = 0, draggedTo = SIZE_MAX;
+    bool haveFrame = false, playing = true, continues = false;
+
+    while (!tigrClosed(screen) && !tigrKeyDown(screen, TK_ESCAPE)) {
+        float frameSeconds = std::min(tigrTime(), 0.1f);
+        int mouseX, mouseY, buttons;
+        tigrMouse(screen, &mouseX, &mouseY, &buttons);
+        updateCamera(screen, frameSeconds);
+        if (tigrKeyDown(screen, 'D')) {
+            RENDERER = RENDERER == RENDER_TILED ? RENDER_TIGR : RENDER_TILED;
+        }
+        if (tigrKeyDown(screen, TK_SPACE)) {
+            playing = !playing;
+        }
+
+        // Seek by keyframes, or to the point clicked on the timeline
+        long seekTo = -1;
+        size_t keyframe = std::upper_bound(player.keyframes.begin(), player.keyframes.end(), shownFrame) -
+                          player.keyframes.begin();  // Keyframes up to and including the shown frame
+        long lastKeyframe = static_cast<long>(player.keyframes.size()) - 1;
+        if (tigrKeyDown(screen, TK_LEFT)) seekTo = std::max(0L, static_cast<long>(keyframe) - 2);
+        if (tigrKeyDown(screen, TK_RIGHT)) seekTo = std::min(lastKeyframe, static_cast<long>(keyframe));
+        if (tigrKeyDown(screen, TK_DOWN)) seekTo = std::max(0L, static_cast<long>(keyframe) - 11);
+        if (tigrKeyDown(screen, TK_UP)) seekTo = std::min(lastKeyframe, static_cast<long>(keyframe) + 9);
+        if (seekTo >= 0 && lastKeyframe >= 0) {
+            seekReplay(player, player.keyframes[seekTo]);
+            continues = false;
+        }
+        if ((buttons & 1) && mouseY >= screen->h - 20 && !player.frameOffsets.empty()) {
+            size_t target = static_cast<size_t>(std::clamp(mouseX - 10, 0, screen->w - 20)) * player.frameOffsets.size() /
+                            std::max(1, screen->w - 20);
+            size_t nearest = nearestKeyframe(player, std::min(target, player.frameOffsets.size() - 1));
+            if (nearest != draggedTo) {
+                // Only seek when the drag reaches another keyframe, so holding still lets it decode
+                seekReplay(player, nearest);
+                draggedTo = nearest;
+                continues = false;
+            }
+        } else {
+            draggedTo = SIZE_MAX;
+        }
+
+        // Show the next frame, unless the decoder hasn't got it yet
+        for (auto& slider : sliders) {
+            updateSlider(slider, mouseX, mouseY, buttons & 1);
+        }
+        world.params.trailLength = sliders[4].currentValue;
+        HUE = sliders[5].currentValue;
+        SIZE = sliders[8].currentValue;
+        if ((playing || !haveFrame || !continues) && takeReplayFrame(player, frame, shownFrame)) {
+            applyReplayFrame(frame, continues, boids, predators);
+            haveFrame = continues = true;
+        }
+
+        RenderTimes renderTimes;
+        renderFrame(screen, boids, predators, sliders, renderTimes);
+        drawTimeline(screen, player, shownFrame);
+        tigrUpdate(screen);
+    }
+
+    tigrFree(screen);
+    closeReplay(player);
+    return 0;
+}
+
+size_t timelineFrameBytes(const TimelineFrame& frame) {
+    return sizeof(TimelineFrame) + frame.data.capacity();
+}
+
+// Keep the timeline within its budget, oldest first. The steps between the oldest
+// keyframes go first, since a keyframe on its own is enough to show and resume from; once
+// the keyframes left that way fill a quarter of the budget, the oldest of them go too.
+// The newest keyframe and the steps after it always stay.
+void trimTimeline(RewindTimeline& timeline) {
+    std::deque<TimelineFrame>& frames = timeline.frames;
+    size_t budget = REWIND_BUDGET_MB << 20;
+    while (timeline.stepBytes + timeline.keyframeBytes > budget && frames.size() > 1) {
+        size_t groupEnd = timeline.thinned + 1;
+        while (groupEnd < frames.size() && !frames[groupEnd].keyframe) groupEnd++;
+        if (groupEnd < frames.size() && timeline.keyframeBytes + timelineFrameBytes(frames[timeline.thinned]) <= budget / 4) {
+            for (size_t i = timeline.thinned; i < groupEnd; i++) {
+                timeline.stepBytes -= timelineFrameBytes(frames[i]);
+            }
+            timeline.keyframeBytes += timelineFrameBytes(frames[timeline.thinned]);
+            frames.erase(frames.begin() + timeline.thinned + 1, frames.begin() + groupEnd);
+            timeline.thinned++;
+        } else if (timeline.thinned > 0) {
+            timeline.keyframeBytes -= timelineFrameBytes(frames.front());
+            frames.pop_front();
+            timeline.thinned--;
+        } else if (groupEnd < frames.size()) {
+            for (size_t i = 0; i < groupEnd; i++) {
+                timeline.stepBytes -= timelineFrameBytes(frames[i]);
+            }
+            frames.erase(frames.begin(), frames.begin() + groupEnd);
+        } else {
+            break;
+        }
+    }
+}
+
+// Encode captured frames into the timeline. Like the recorder, a gap in the steps (or a
+// change in the flock) starts a new keyframe.
+void timelineEncoder(RewindTimeline& timeline) {
+    setTraceThreadName("timeline");
+    std::unique_lock<std::mutex> lock(timeline.mutex);
+    while (true) {
+        timeline.wake.wait(lock, [&]() { return timeline.quit || timeline.tail < timeline.head; });
+        if (timeline.tail == timeline.head) return;
+        size_t slot = timeline.tail % timeline.ring.size();
+        lock.unlock();
+
+        uint64_t traceStart = traceBegin();
+        const RecordedFrame& captured = timeline.ring[slot];
+        timeline.encoded.clear();
+        encodeFrame(timeline.codec, captured, timeline.codec.sinceKeyframe + 1 >= RECORD_KEYFRAME_INTERVAL, timeline.encoded);
+        TimelineFrame frame = {captured.step, timeline.codec.sinceKeyframe == 0, timeline.ringWindTime[slot],
+                               std::vector<uint8_t>(timeline.encoded.begin(), timeline.encoded.end())};
+        traceEnd("encode timeline frame", traceStart);
+
+        lock.lock();
+        timeline.stepBytes += timelineFrameBytes(frame);
+        timeline.frames.push_back(std::move(frame));
+        trimTimeline(timeline);
+        timeline.tail++;
+        if (timeline.tail == timeline.head) timeline.idle.notify_all();
+    }
+}
+
+// Capture the step just taken for the timeline, starting its encoder the first time.
+// As with the recorder, a full ring drops the frame rather than holding up the step.
+void recordTimeline(RewindTimeline& timeline, const Flock& boids, const Flock& predators) {
+    if (REWIND_BUDGET_MB == 0) return;
+    if (!timeline.thread.joinable()) {
+        timeline.ring.resize(RECORD_RING_FRAMES);
+        timeline.ringWindTime.resize(RECORD_RING_FRAMES);
+        timeline.quit = false;
+        timeline.thread = std::thread(timelineEncoder, std::ref(timeline));
+    }
+    size_t slot;
+    {
+        std::lock_guard<std::mutex> lock(timeline.mutex);
+        if (timeline.head - timeline.tail == timeline.ring.size()) {
+            timeline.dropped++;
+            return;
+        }
+        slot = timeline.head % timeline.ring.size();
+    }
+    uint64_t traceStart = traceBegin();
+    captureFrame(timeline.ring[slot], boids, predators);
+    timeline.ringWindTime[slot] = world.wind.time;
+    traceEnd("capture timeline frame", traceStart);
+    {
+        std::lock_guard<std::mutex> lock(timeline.mutex);
+        timeline.head++;
+    }
+    timeline.wake.notify_one();
+}
+
+// Wait until every captured frame is in the timeline
+void flushTimeline(RewindTimeline& timeline) {
+    std::unique_lock<std::mutex> lock(timeline.mutex);
+    timeline.idle.wait(lock, [&]() { return timeline.tail == timeline.head; });
+}
+
+void stopTimeline(RewindTimeline& timeline) {
+    if (!timeline.thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(timeline.mutex);
+        timeline.quit = true;
+    }
+    timeline.wake.notify_one();
+    timeline.thread.join();
+}
+
+// Forget the history, e.g. when the flock is reset
+void clearTimeline(RewindTimeline& timeline) {
+    flushTimeline(timeline);
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    timeline.frames.clear();
+    timeline.thinned = 0;
+    timeline.stepBytes = timeline.keyframeBytes = 0;
+    timeline.codec.valid = false;
+    timeline.rewound = false;
+}
+
+// Show a frame of the timeline. Stepping forward one frame carries on decoding from the
+// frame shown; anything else starts from the keyframe at or before it.
+void showTimelineFrame(RewindTimeline& timeline, size_t index, Flock& boids, Flock& predators) {
+    bool stepping = timeline.rewound && index == timeline.shown + 1;
+    size_t first = index;
+    while (!stepping && first > 0 && !timeline.frames[first].keyframe) first--;
+    for (size_t i = first; i <= index; i++) {
+        const TimelineFrame& frame = timeline.frames[i];
+        bool continues = timeline.viewCodec.valid && frame.step == timeline.viewCodec.step + 1 && (i > first || stepping);
+        if (!decodeFrame(timeline.viewCodec, frame.data.data(), frame.data.size(), timeline.view)) return;
+        applyReplayFrame(timeline.view, continues, boids, predators);
+    }
+    timeline.rewound = true;
+    timeline.shown = index;
+}
+
+// Holding B jumps back a keyframe per frame; N then steps forward one recorded step at a
+// time. Either pauses the simulation, and resuming carries on from the frame shown.
+void updateRewind(Tigr* screen, RewindTimeline& timeline, bool& animationRunning, Flock& boids, Flock& predators) {
+    bool back = tigrKeyHeld(screen, 'B'), forward = tigrKeyHeld(screen, 'N');
+    if (!back && !forward) return;
+    animationRunning = false;
+    flushTimeline(timeline);
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    if (timeline.frames.empty()) return;
+    size_t current = timeline.rewound ? timeline.shown : timeline.frames.size() - 1;
+    if (back) {
+        size_t target = current;
+        while (target > 0 && !timeline.frames[--target].keyframe) {}
+        if (timeline.frames[target].keyframe && target < current) showTimelineFrame(timeline, target, boids, predators);
+    } else if (timeline.rewound && current + 1 < timeline.frames.size()) {
+        showTimelineFrame(timeline, current + 1, boids, predators);
+    }
+}
+
+// Carry on from the frame shown: the steps after it are dropped, and the step counter and
+// wind go back to where they were, so the run continues as it would have from there
+// (with the slider values as they are now). Boids added or nudged while rewound stay.
+void resumeFromTimeline(RewindTimeline& timeline) {
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    std::deque<TimelineFrame>& frames = timeline.frames;
+    for (size_t i = timeline.shown + 1; i < frames.size(); i++) {
+        (i < timeline.thinned ? timeline.keyframeBytes : timeline.stepBytes) -= timelineFrameBytes(frames[i]);
+    }
+    frames.erase(frames.begin() + timeline.shown + 1, frames.end());
+    if (timeline.thinned > timeline.shown) {
+        // Resuming from a thinned keyframe: it leads the every-step part again
+        timeline.keyframeBytes -= timelineFrameBytes(frames.back());
+        timeline.stepBytes += timelineFrameBytes(frames.back());
+        timeline.thinned = timeline.shown;
+    }
+    world.step = frames.back().step;
+    world.wind.time = frames.back().windTime;
+    timeline.codec = timeline.viewCodec;
+    timeline.rewound = false;
+}
+
+#ifndef _WIN32
+// Create the segment with room for the given flock, laid out like a snapshot: each array
+// of each slot starts on a 64-byte boundary
+bool openSharedState(SharedStatePublisher& publisher, uint32_t boidCapacity, uint32_t predatorCapacity) {
+    uint64_t arrayOffsets[SHARED_ARRAYS];
+    uint64_t offset = sizeof(SharedStateSlot);
+    for (int array = 0; array < SHARED_ARRAYS; array++) {
+        offset = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        arrayOffsets[array] = offset;
+        offset += static_cast<uint64_t>(array < SHARED_PREDATOR_X ? boidCapacity : predatorCapacity) * 4;
+    }
+    uint64_t slotSize = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    uint64_t slotsOffset = (sizeof(SharedStateHeader) + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    uint64_t segmentSize = slotsOffset + slotSize * SHARED_STATE_SLOTS;
+
+    shm_unlink(publisher.name.c_str());
+    int fd = shm_open(publisher.name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return false;
+    if (ftruncate(fd, segmentSize) != 0) {
+        close(fd);
+        shm_unlink(publisher.name.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(publisher.name.c_str());
+        return false;
+    }
+
+    // A fresh segment reads as zeros, so the sequence numbers and counters start at 0
+    publisher.base = static_cast<uint8_t*>(base);
+    publisher.header = static_cast<SharedStateHeader*>(base);
+    SharedStateHeader& header = *publisher.header;
+    header.magic = SHARED_STATE_MAGIC;
+    header.version = SHARED_STATE_VERSION;
+    header.numSlots = SHARED_STATE_SLOTS;
+    header.boidCapacity = boidCapacity;
+    header.predatorCapacity = predatorCapacity;
+    header.segmentSize = segmentSize;
+    header.slotsOffset = slotsOffset;
+    header.slotSize = slotSize;
+    memcpy(header.arrayOffsets, arrayOffsets, sizeof(arrayOffsets));
+    header.worldWidth = world.params.width;
+    header.worldHeight = world.params.height;
+    return true;
+}
+
+// Tell readers the segment is finished with, and let go of it. The name is unlinked, but
+// readers that still have it mapped keep their view of it.
+void closeSharedState(SharedStatePublisher& publisher) {
+    if (!publisher.base) return;
+    publisher.header->closed.store(1, std::memory_order_release);
+    munmap(publisher.base, publisher.header->segmentSize);
+    shm_unlink(publisher.name.c_str());
+    publisher.base = nullptr;
+    publisher.header = nullptr;
+}
+#else
+bool openSharedState(SharedStatePublisher&, uint32_t, uint32_t) {
+    std::cerr << "Shared memory is not supported on this platform" << std::endl;
+    return false;
+}
+
+void closeSharedState(SharedStatePublisher&) {}
+#endif
+
+// Write the step just taken into the next slot of the ring. The writer never waits for
+// readers: a reader checks the slot's sequence number before and after it reads, and
+// reads again if the slot changed underneath it. With several slots, a reader has a few
+// steps to finish with the newest one before it is overwritten. A flock that outgrows the
+// segment moves to a new, bigger one under the same name.
+bool publishState(SharedStatePublisher& publisher, const Flock& boids, const Flock& predators) {
+    if (publisher.name.empty()) return false;
+    if (!publisher.header || boids.size() > publisher.header->boidCapacity ||
+        predators.size() > publisher.header->predatorCapacity) {
+        closeSharedState(publisher);
+        uint32_t boidCapacity = static_cast<uint32_t>(std::max<size_t>(4096, boids.size() * 2));
+        uint32_t predatorCapacity = static_cast<uint32_t>(std::max<size_t>(64, predators.size() * 2));
+        if (!openSharedState(publisher, boidCapacity, predatorCapacity)) {
+            std::cerr << "Could not create shared memory " << publisher.name << std::endl;
+            publisher.name.clear();
+            return false;
+        }
+    }
+
+    uint64_t traceStart = traceBegin();
+    SharedStateHeader& header = *publisher.header;
+    uint64_t published = header.published.load(std::memory_order_relaxed);
+    uint8_t* slotBase = publisher.base + header.slotsOffset + (published % header.numSlots) * header.slotSize;
+    SharedStateSlot& slot = *reinterpret_cast<SharedStateSlot*>(slotBase);
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.step = world.step;
+    slot.numBoids = static_cast<uint32_t>(boids.size());
+    slot.numPredators = static_cast<uint32_t>(predators.size());
+    uint32_t* id = reinterpret_cast<uint32_t*>(slotBase + header.arrayOffsets[SHARED_BOID_ID]);
+    float* x = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_BOID_X]);
+    float* y = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_BOID_Y]);
+    float* dx = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_BOID_DX]);
+    float* dy = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_BOID_DY]);
+    parallelFor(workers, boids.size(), 4096, [&](size_t begin, size_t end, int) {
+        std::copy(boids.id.begin() + begin, boids.id.begin() + end, id + begin);
+        std::copy(boids.x.begin() + begin, boids.x.begin() + end, x + begin);
+        std::copy(boids.y.begin() + begin, boids.y.begin() + end, y + begin);
+        std::copy(boids.dx.begin() + begin, boids.dx.begin() + end, dx + begin);
+        std::copy(boids.dy.begin() + begin, boids.dy.begin() + end, dy + begin);
+    });
+    float* predatorX = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_PREDATOR_X]);
+    float* predatorY = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_PREDATOR_Y]);
+    float* predatorDx = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_PREDATOR_DX]);
+    float* predatorDy = reinterpret_cast<float*>(slotBase + header.arrayOffsets[SHARED_PREDATOR_DY]);
+    std::copy(predators.x.begin(), predators.x.end(), predatorX);
+    std::copy(predators.y.begin(), predators.y.end(), predatorY);
+    std::copy(predators.dx.begin(), predators.dx.end(), predatorDx);
+    std::copy(predators.dy.begin(), predators.dy.end(), predatorDy);
+    header.worldWidth = world.params.width;
+    header.worldHeight = world.params.height;
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    header.published.store(published + 1, std::memory_order_release);
+    traceEnd("publish state", traceStart);
+    return true;
+}
+
+#ifndef _WIN32
+// Example reader: map a run's shared state read-only and print a summary of the newest
+// step a few times a second, straight from the shared arrays. Reopens the segment when
+// the writer moves to a bigger one, and exits when the writer does.
+int watchSharedState(const std::string& name) {
+    while (true) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            // Between the writer dropping a segment and creating its replacement
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        struct stat info;
+        void* base = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(SharedStateHeader)) {
+            base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(base);
+        const SharedStateHeader& header = *static_cast<const SharedStateHeader*>(base);
+        if (header.magic != SHARED_STATE_MAGIC || header.version != SHARED_STATE_VERSION ||
+            header.segmentSize > static_cast<uint64_t>(info.st_size)) {
+            munmap(base, info.st_size);
+            std::cerr << "Not a boids shared-memory segment: " << name << std::endl;
+            return 1;
+        }
+
+        uint32_t lastStep = UINT32_MAX;
+        int retries = 0;
+        while (!header.closed.load(std::memory_order_acquire)) {
+            uint64_t published = header.published.load(std::memory_order_acquire);
+            if (published == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            const uint8_t* slotBase = bytes + header.slotsOffset + ((published - 1) % header.numSlots) * header.slotSize;
+            const SharedStateSlot& slot = *reinterpret_cast<const SharedStateSlot*>(slotBase);
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence & 1) continue;
+
+            uint32_t step = slot.step;
+            uint32_t numBoids = std::min(slot.numBoids, header.boidCapacity);
+            const float* x = reinterpret_cast<const float*>(slotBase + header.arrayOffsets[SHARED_BOID_X]);
+            const float* y = reinterpret_cast<const float*>(slotBase + header.arrayOffsets[SHARED_BOID_Y]);
+            const float* dx = reinterpret_cast<const float*>(slotBase + header.arrayOffsets[SHARED_BOID_DX]);
+            const float* dy = reinterpret_cast<const float*>(slotBase + header.arrayOffsets[SHARED_BOID_DY]);
+            double sumX = 0, sumY = 0, sumSpeed = 0;
+            for (uint32_t i = 0; i < numBoids; i++) {
+                sumX += x[i];
+                sumY += y[i];
+                sumSpeed += std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+            }
+
+            // Only trust what was read if the slot wasn't rewritten meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                retries++;
+                continue;
+            }
+            if (step != lastStep) {
+                double count = std::max(1u, numBoids);
+                printf("step %u: %u boids, centroid (%.1f, %.1f), mean speed %.3f, %d retries\n", step, numBoids,
+                       sumX / count, sumY / count, sumSpeed / count, retries);
+                fflush(stdout);
+                lastStep = step;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+
+        // Closed: either replaced by a bigger segment, or the writer is gone
+        munmap(base, info.st_size);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        int check = shm_open(name.c_str(), O_RDONLY, 0);
+        if (check < 0) return 0;
+        close(check);
+    }
+}
+#else
+int watchSharedState(const std::string&) {
+    std::cerr << "Shared memory is not supported on this platform" << std::endl;
+    return 1;
+}
+#endif
+
+#ifndef _WIN32
+// Bytes queued for a client but not yet taken by its socket
+size_t streamBacklog(const StreamClient& client) {
+    return client.pending.size() - client.sent;
+}
+
+// Encode each captured frame once per client, against what that client was last sent.
+// A client that is too far behind either skips the frame (its next frame is then a
+// keyframe) or, if it asked to be downsampled, gets every other boid, then every fourth
+// and so on, until it keeps up again.
+void streamEncoder(StreamServer& server) {
+    setTraceThreadName("stream encoder");
+    std::unique_lock<std::mutex> lock(server.mutex);
+    while (true) {
+        server.wake.wait(lock, [&]() { return server.quit || server.tail < server.head; });
+        if (server.tail == server.head) return;
+        const RecordedFrame& frame = server.ring[server.tail % server.ring.size()];
+        std::vector<std::shared_ptr<StreamClient>> clients = server.clients;
+        lock.unlock();
+
+        uint64_t traceStart = traceBegin();
+        bool queued = false;
+        for (auto& client : clients) {
+            size_t backlog;
+            {
+                std::lock_guard<std::mutex> clientLock(server.mutex);
+                backlog = streamBacklog(*client);
+            }
+            const RecordedFrame* send = &frame;
+            if (client->policy == STREAM_DOWNSAMPLE) {
+                if (backlog > STREAM_CLIENT_BACKLOG / 2 && client->stride < STREAM_MAX_STRIDE) client->stride *= 2;
+                if (backlog < STREAM_CLIENT_BACKLOG / 8 && client->stride > 1) client->stride /= 2;
+                if (client->stride > 1) {
+                    RecordedFrame& subset = server.subset;
+                    subset.step = frame.step;
+                    subset.ids.clear();
+                    subset.x.clear();
+                    subset.y.clear();
+                    subset.dx.clear();
+                    subset.dy.clear();
+                    for (size_t i = 0; i < frame.ids.size(); i++) {
+                        if (frame.ids[i] % client->stride != 0) continue;
+                        subset.ids.push_back(frame.ids[i]);
+                        subset.x.push_back(frame.x[i]);
+                        subset.y.push_back(frame.y[i]);
+                        subset.dx.push_back(frame.dx[i]);
+                        subset.dy.push_back(frame.dy[i]);
+                    }
+                    subset.predators = frame.predators;
+                    send = &subset;
+                }
+            }
+            if (backlog > STREAM_CLIENT_BACKLOG) {
+                client->dropped++;
+                continue;
+            }
+            server.encoded.clear();
+            encodeFrame(client->codec, *send, client->codec.sinceKeyframe + 1 >= RECORD_KEYFRAME_INTERVAL, server.encoded);
+            std::lock_guard<std::mutex> clientLock(server.mutex);
+            client->pending.insert(client->pending.end(), server.encoded.begin(), server.encoded.end());
+            client->frames++;
+            queued = true;
+        }
+        traceEnd("encode stream frame", traceStart);
+        if (queued) {
+            char byte = 0;
+            (void)!write(server.wakePipe[1], &byte, 1);
+        }
+
+        lock.lock();
+        server.tail++;
+    }
+}
+
+// Accept clients, read their requests and send whatever has been encoded for them,
+// without ever blocking on one client. A client may send "drop" or "downsample" on a
+// line of its own to pick how it is slowed down.
+void streamNetwork(StreamServer& server) {
+    setTraceThreadName("stream network");
+    std::vector<pollfd> polls;
+    std::vector<std::shared_ptr<StreamClient>> polled;
+    while (true) {
+        {
+            // When stopping, carry on until the encoder is done and the clients have
+            // taken what was queued for them, or have had a second to
+            std::lock_guard<std::mutex> lock(server.mutex);
+            if (server.quit && server.tail == server.head) {
+                size_t backlog = 0;
+                for (auto& client : server.clients) backlog += client->closed ? 0 : streamBacklog(*client);
+                if (backlog == 0 || std::chrono::steady_clock::now() > server.stopBy) break;
+            }
+            polled = server.clients;
+            polls.assign(1, {server.listenFd, POLLIN, 0});
+            polls.push_back({server.wakePipe[0], POLLIN, 0});
+            for (auto& client : polled) {
+                polls.push_back({client->fd, static_cast<short>(POLLIN | (streamBacklog(*client) > 0 ? POLLOUT : 0)), 0});
+            }
+        }
+        if (poll(polls.data(), polls.size(), 100) < 0) continue;
+
+        if (polls[1].revents & POLLIN) {
+            char drain[64];
+            (void)!read(server.wakePipe[0], drain, sizeof(drain));
+        }
+        if (polls[0].revents & POLLIN) {
+            int fd = accept(server.listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                auto client = std::make_shared<StreamClient>();
+                client->fd = fd;
+                RecordingHeader header = {RECORDING_MAGIC, RECORDING_VERSION, world.params.width, world.params.height,
+                                          client->codec.positionScale, client->codec.velocityScale,
+                                          RECORD_KEYFRAME_INTERVAL, 0, world.seed};
+                client->pending.assign(reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header + 1));
+                std::lock_guard<std::mutex> lock(server.mutex);
+                server.clients.push_back(client);
+                server.served++;
+            }
+        }
+
+        for (size_t i = 0; i < polled.size(); i++) {
+            StreamClient& client = *polled[i];
+            short events = polls[i + 2].revents;
+            if (events & POLLIN) {
+                char buffer[256];
+                ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    client.closed = true;
+                } else {
+                    client.request.append(buffer, received);
+                    size_t end;
+                    while ((end = client.request.find('\n')) != std::string::npos) {
+                        std::string line = client.request.substr(0, end);
+                        if (!line.empty() && line.back() == '\r') line.pop_back();
+                        if (line == "drop") client.policy = STREAM_DROP_FRAMES;
+                        if (line == "downsample") client.policy = STREAM_DOWNSAMPLE;
+                        client.request.erase(0, end + 1);
+                    }
+                    if (client.request.size() > 256) client.request.clear();
+                }
+            }
+            if (events & (POLLERR | POLLHUP)) client.closed = true;
+            if ((events & POLLOUT) && !client.closed) {
+                std::lock_guard<std::mutex> lock(server.mutex);
+                ssize_t written = send(client.fd, client.pending.data() + client.sent, streamBacklog(client), 0);
+                if (written > 0) client.sent += written;
+                if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) client.closed = true;
+                if (client.sent == client.pending.size()) {
+                    client.pending.clear();
+                    client.sent = 0;
+                } else if (client.sent > STREAM_CLIENT_BACKLOG) {
+                    client.pending.erase(client.pending.begin(), client.pending.begin() + client.sent);
+                    client.sent = 0;
+                }
+            }
+        }
+
+        // Let go of clients that hung up
+        std::lock_guard<std::mutex> lock(server.mutex);
+        for (auto& client : polled) {
+            if (!client->closed) continue;
+            close(client->fd);
+            server.clients.erase(std::find(server.clients.begin(), server.clients.end(), client));
+        }
+    }
+}
+
+// Listen on 127.0.0.1 and start the encoder and network threads
+bool startStreamServer(StreamServer& server, int port) {
+    signal(SIGPIPE, SIG_IGN);
+    server.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server.listenFd < 0) return false;
+    int on = 1;
+    setsockopt(server.listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server.listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(server.listenFd, 16) != 0 || pipe(server.wakePipe) != 0) {
+        close(server.listenFd);
+        server.listenFd = -1;
+        return false;
+    }
+    fcntl(server.wakePipe[0], F_SETFL, fcntl(server.wakePipe[0], F_GETFL) | O_NONBLOCK);
+    server.ring.resize(RECORD_RING_FRAMES);
+    server.encoder = std::thread(streamEncoder, std::ref(server));
+    server.network = std::thread(streamNetwork, std::ref(server));
+    printf("streaming on 127.0.0.1:%d\n", port);
+    return true;
+}
+
+// Hand the step just taken to the encoder, or drop it if the encoder is behind. With no
+// clients connected, nothing is captured at all.
+void streamFrame(StreamServer& server, const Flock& boids, const Flock& predators) {
+    if (server.listenFd < 0) return;
+    RecordedFrame* frame;
+    {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        if (server.clients.empty()) return;
+        if (server.head - server.tail == server.ring.size()) {
+            server.dropped++;
+            return;
+        }
+        frame = &server.ring[server.head % server.ring.size()];
+    }
+    uint64_t traceStart = traceBegin();
+    captureFrame(*frame, boids, predators);
+    traceEnd("capture stream frame", traceStart);
+    {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        server.head++;
+    }
+    server.wake.notify_one();
+}
+
+// Encode what has been captured, give the clients a moment to take what is queued for
+// them, then hang up on everyone
+void stopStreamServer(StreamServer& server) {
+    if (server.listenFd < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        server.quit = true;
+        server.stopBy = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    }
+    server.wake.notify_one();
+    server.encoder.join();
+    server.network.join();
+    for (auto& client : server.clients) {
+        printf("stream client: %llu frames sent, %llu dropped\n", static_cast<unsigned long long>(client->frames),
+               static_cast<unsigned long long>(client->dropped));
+        close(client->fd);
+    }
+    printf("streamed to %llu clients (%llu steps dropped before encoding)\n",
+           static_cast<unsigned long long>(server.served), static_cast<unsigned long long>(server.dropped));
+    server.clients.clear();
+    close(server.listenFd);
+    close(server.wakePipe[0]);
+    close(server.wakePipe[1]);
+    server.listenFd = -1;
+}
+#else
+bool startStreamServer(StreamServer&, int) {
+    std::cerr << "Streaming is not supported on this platform" << std::endl;
+    return false;
+}
+
+void streamFrame(StreamServer&, const Flock&, const Flock&) {}
+
+void stopStreamServer(StreamServer&) {}
+#endif
+
+void drawBoid(Tigr* screen, const Boid& boid) {
+    // Blit the pre-rasterized rectangle (3:1 ratio) nearest the boid's heading
+    updateSprites(sprites);
+    blitSprite(screen, sprites.boids[spriteHeading(boid.dx, boid.dy)], toScreenX(boid.x), toScreenY(boid.y), boidColor,
+               TileRect{0, 0, screen->w, screen->h});
+}
+
+void drawTrail(Tigr* screen, const Flock& boids, size_t b) {
+    size_t trailSize = boids.trailCount[b];
+    for (size_t i = 1; i < trailSize; ++i) {
+        TPixel trailColor = boidColor;
+        trailColor.a = static_cast<unsigned char>(175 * (i / static_cast<float>(trailSize)));
+        size_t from = trailPoint(boids, b, i - 1), to = trailPoint(boids, b, i);
+        tigrLine(screen, 
+                 static_cast<int>(toScreenX(boids.trailX[from])), static_cast<int>(toScreenY(boids.trailY[from])),
+                 static_cast<int>(toScreenX(boids.trailX[to])), static_cast<int>(toScreenY(boids.trailY[to])),
+                 trailColor);
+    }
+}
+
+void drawPredator(Tigr* screen, const Predator& predator) {
+    // Blit the pre-rasterized rectangle (3:1 ratio, twice the boid size) nearest its heading
+    updateSprites(sprites);
+    blitSprite(screen, sprites.predators[spriteHeading(predator.dx, predator.dy)], toScreenX(predator.x),
+               toScreenY(predator.y), predatorColor, TileRect{0, 0, screen->w, screen->h});
+}
+
+// Rasterize a solid width x height rectangle rotated by angle, centered on a pixel
+Sprite rasterizeSprite(float width, float height, float angle) {
+    Sprite sprite;
+    float cosAngle = std::cos(angle);
+    float sinAngle = std::sin(angle);
+    int reach = static_cast<int>(std::ceil(std::hypot(width, height) / 2));
+    sprite.top = -reach;
+    for (int y = -reach; y <= reach; y++) {
+        int16_t x0 = INT16_MAX, x1 = INT16_MIN;
+        for (int x = -reach; x <= reach; x++) {
+            float localX = x * cosAngle + y * sinAngle;
+            float localY = -x * sinAngle + y * cosAngle;
+            if (localX >= -width/2 && localX <= width/2 && localY >= -height/2 && localY <= height/2) {
+                x0 = std::min<int16_t>(x0, x);
+                x1 = std::max<int16_t>(x1, x);
+            }
+        }
+        sprite.x0.push_back(x0);
+        sprite.x1.push_back(x1);
+    }
+    return sprite;
+}
+
+// Rebuild the boid and predator sprites if SIZE or the zoom has changed since they were drawn
+void updateSprites(SpriteAtlas& atlas) {
+    float size = SIZE * camera.zoom;
+    if (atlas.size == size) return;
+    atlas.size = size;
+    atlas.boids.resize(SPRITE_HEADINGS);
+    atlas.predators.resize(SPRITE_HEADINGS);
+    for (int i = 0; i < SPRITE_HEADINGS; i++) {
+        float angle = i * 2 * static_cast<float>(M_PI) / SPRITE_HEADINGS;
+        atlas.boids[i] = rasterizeSprite(size * 3, size, angle);
+        atlas.predators[i] = rasterizeSprite(size * 2 * 3, size * 2, angle);
+    }
+}
+
+// Index of the sprite heading nearest a velocity
+int spriteHeading(float dx, float dy) {
+    float turns = std::atan2(dy, dx) * (SPRITE_HEADINGS / (2 * static_cast<float>(M_PI)));
+    int heading = static_cast<int>(std::lround(turns)) % SPRITE_HEADINGS;
+    return heading < 0 ? heading + SPRITE_HEADINGS : heading;
+}
+
+// Draw a sprite centered on the pixel nearest (x, y), one clipped span per row. Opaque
+// colors are plain fills; translucent ones blend like tigrPlot.
+void blitSprite(Tigr* screen, const Sprite& sprite, float x, float y, TPixel color, const TileRect& clip) {
+    int cx = static_cast<int>(std::lround(x));
+    int cy = static_cast<int>(std::lround(y));
+    for (size_t row = 0; row < sprite.x0.size(); row++) {
+        int py = cy + sprite.top + static_cast<int>(row);
+        if (py < clip.y0 || py >= clip.y1) continue;
+        int x0 = std::max(cx + sprite.x0[row], clip.x0);
+        int x1 = std::min(cx + sprite.x1[row], clip.x1 - 1);
+        if (x0 > x1) continue;
+        TPixel* pixels = screen->pix + py * screen->w;
+        if (color.a == 255) {
+            std::fill(pixels + x0, pixels + x1 + 1, color);
+        } else {
+            for (int px = x0; px <= x1; px++) blendPixel(pixels[px], color);
+        }
+    }
+}
+
+// Load an obstacle mask (bright, opaque pixels are solid) stretched over the world, hand
+// it to the simulation, and pre-draw the obstacles once, at mask resolution, so frames
+// only have to blit them
+bool loadObstacles(const char* fileName, ObstacleField& field) {
+    Tigr* mask = tigrLoadImage(fileName);
+    if (!mask) return false;
+
+    int w = mask->w, h = mask->h;
+    std::vector<bool> solid(w * h);
+    for (int i = 0; i < w * h; i++) {
+        TPixel p = mask->pix[i];
+        solid[i] = p.a >= 128 && (p.r + p.g + p.b) >= 3 * 128;
+    }
+    tigrFree(mask);
+    if (!buildObstacleField(solid, w, h, world.params, field)) return false;
+
+    if (obstacleLayer) tigrFree(obstacleLayer);
+    obstacleLayer = tigrBitmap(w, h);
+    for (int i = 0; i < w * h; i++) {
+        obstacleLayer->pix[i] = field.sdf[i] < 0 ? tigrRGB(60, 60, 70) : tigrRGBA(0, 0, 0, 0);
+    }
+    return true;
+}
+
+void drawObstacles(Tigr* screen) {
+    compositeObstacles(screen, obstacleLayer, TileRect{0, 0, screen->w, screen->h});
+}
+
+// Blend the mask-sized obstacle layer into a rectangle of the screen, through the camera
+// and stretched over the world the way the simulation sees it: each pixel takes the layer
+// pixel under its center
+void compositeObstacles(Tigr* screen, const Tigr* layer, const TileRect& clip) {
+    if (!layer) return;
+    const ObstacleField& field = world.obstacles;
+    float scaleX = 1.0f / (camera.zoom * field.cellW), scaleY = 1.0f / (camera.zoom * field.cellH);
+    float originX = camera.x / field.cellW, originY = camera.y / field.cellH;
+    for (int y = clip.y0; y < clip.y1; y++) {
+        int layerY = static_cast<int>(std::floor(originY + (y + 0.5f) * scaleY));
+        if (layerY < 0 || layerY >= layer->h) continue;
+        const TPixel* src = layer->pix + layerY * layer->w;
+        TPixel* row = screen->pix + y * screen->w;
+        for (int x = clip.x0; x < clip.x1; x++) {
+            int layerX = static_cast<int>(std::floor(originX + (x + 0.5f) * scaleX));
+            if (layerX >= 0 && layerX < layer->w) blendPixel(row[x], src[layerX]);
+        }
+    }
+}
+
+// World to screen coordinates
+float toScreenX(float x) {
+    return (x - camera.x) * camera.zoom;
+}
+
+float toScreenY(float y) {
+    return (y - camera.y) * camera.zoom;
+}
+
+// Pan with I/J/K/L and zoom about the middle of the window with = and -, at the same
+// on-screen speed whatever the zoom. Home fits the whole world in the window.
+void updateCamera(Tigr* screen, float dt) {
+    float pan = CAMERA_PAN_SPEED * dt / camera.zoom;
+    if (tigrKeyHeld(screen, 'J')) camera.x -= pan;
+    if (tigrKeyHeld(screen, 'L')) camera.x += pan;
+    if (tigrKeyHeld(screen, 'I')) camera.y -= pan;
+    if (tigrKeyHeld(screen, 'K')) camera.y += pan;
+
+    float zoom = camera.zoom;
+    if (tigrKeyHeld(screen, TK_EQUALS)) zoom *= std::pow(CAMERA_ZOOM_SPEED, dt);
+    if (tigrKeyHeld(screen, TK_MINUS)) zoom /= std::pow(CAMERA_ZOOM_SPEED, dt);
+    zoom = std::clamp(zoom, CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM);
+    if (zoom != camera.zoom) {
+        float centerX = camera.x + screen->w * 0.5f / camera.zoom;
+        float centerY = camera.y + screen->h * 0.5f / camera.zoom;
+        camera.zoom = zoom;
+        camera.x = centerX - screen->w * 0.5f / zoom;
+        camera.y = centerY - screen->h * 0.5f / zoom;
+    }
+
+    if (tigrKeyDown(screen, TK_HOME)) {
+        fitCamera(screen->w, screen->h);
+    }
+}
+
+// Zoom so the whole world fits a width x height window, and center it
+void fitCamera(int width, int height) {
+    float zoom = std::min(width / static_cast<float>(world.params.width), height / static_cast<float>(world.params.height));
+    camera.zoom = std::clamp(zoom, CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM);
+    camera.x = (world.params.width - width / camera.zoom) * 0.5f;
+    camera.y = (world.params.height - height / camera.zoom) * 0.5f;
+}
+
+// Indices, in flock order, of the boids whose body or trail may be on screen. The view
+// is padded by a trail's reach, and the grid from the last step narrows the search to
+// the cells under it; without a current grid every boid is tested.
+void findVisibleBoids(const Flock& boids, int width, int height, std::vector<uint32_t>& visible) {
+    float reach = world.params.speedLimit * (world.params.trailLength + 2) + SIZE * 6;
+    float x0 = camera.x - reach, y0 = camera.y - reach;
+    float x1 = camera.x + width / camera.zoom + reach, y1 = camera.y + height / camera.zoom + reach;
+    size_t numBoids = boids.size();
+    visible.clear();
+
+    const SpatialGrid& grid = world.grid;
+    bool gridCurrent = world.params.backend == BACKEND_GRID && world.params.mode == MODE_FLOAT && grid.indices.size() == numBoids;
+    if (x0 <= 0 && y0 <= 0 && x1 >= world.params.width && y1 >= world.params.height) {
+        // The whole world is in view
+        visible.resize(numBoids);
+        for (size_t i = 0; i < numBoids; i++) {
+            visible[i] = static_cast<uint32_t>(i);
+        }
+    } else if (gridCurrent) {
+        // Edge cells also hold the boids outside the world, so clamping the range keeps them
+        int cx0 = std::clamp(static_cast<int>(std::floor(x0 / grid.cellSize)), 0, grid.w - 1);
+        int cy0 = std::clamp(static_cast<int>(std::floor(y0 / grid.cellSize)), 0, grid.h - 1);
+        int cx1 = std::clamp(static_cast<int>(std::floor(x1 / grid.cellSize)), 0, grid.w - 1);
+        int cy1 = std::clamp(static_cast<int>(std::floor(y1 / grid.cellSize)), 0, grid.h - 1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            visible.insert(visible.end(), grid.indices.begin() + grid.cellStart[cy * grid.w + cx0],
+                           grid.indices.begin() + grid.cellStart[cy * grid.w + cx1 + 1]);
+        }
+        std::sort(visible.begin(), visible.end());
+    } else {
+        for (size_t i = 0; i < numBoids; i++) {
+            if (boids.x[i] >= x0 && boids.x[i] <= x1 && boids.y[i] >= y0 && boids.y[i] <= y1) {
+                visible.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+}
+
+void drawSlider(Tigr* screen, Slider& slider) {
+    // Draw slider background
+    tigrFillRect(screen, slider.x, slider.y, slider.width, slider.height, tigrRGB(50, 50, 50));
+    
+    // Draw slider handle
     float handlePos = slider.x + (slider.currentValue - slider.minValue) / (slider.maxValue - slider.minValue) * slider.width;
     tigrFillRect(screen, handlePos - 5, slider.y, 10, slider.height, tigrRGB(200, 200, 200));
     
@@ -632,6 +3779,501 @@ void drawSlider(Tigr* screen, Slider& slider) {
     tigrPrint(screen, tfont, slider.x + slider.width + 10, slider.y, tigrRGB(255, 255, 255), valueText);
 }
 
+// The parameter sliders, starting at the current parameter values
+std::vector<Slider> createSliders() {
+    return {
+        {10, 10, 200, 20, 0.0f, 0.02f, world.params.centeringFactor, "Centering Factor"},
+        {10, 40, 200, 20, 0.0f, 0.2f, world.params.avoidFactor, "Avoid Factor"},
+        {10, 70, 200, 20, 0.0f, 0.2f, world.params.matchingFactor, "Matching Factor"},
+        {10, 100, 200, 20, 5.0f, 30.0f, world.params.speedLimit, "Speed Limit"},
+        {10, 130, 200, 20, 0.0f, 100.0f, world.params.trailLength, "Trail Length"},
+        {10, 160, 200, 20, 0.0f, 1.0f, HUE, "Color"},
+        {10, 190, 200, 20, 50.0f, 400.0f, world.params.margin, "Margin"},
+        {10, 220, 200, 20, 0.1f, 3.0f, world.params.turnFactor, "Turn Factor"},
+        {10, 250, 200, 20, 1.0f, 10.0f, SIZE, "Size"}
+    };
+}
+
+// Redraw the slider panel if a slider has moved since it was last drawn, and draw the
+// instructions panel the first time through
+void updateUiOverlay(UiOverlay& overlay, std::vector<Slider>& sliders) {
+    const char* instructions[] = {
+        "Hotkeys:",
+        "R: Reset simulation",
+        "Arrow keys: Nudge boids",
+        "I/J/K/L: Pan",
+        "=/-: Zoom in/out",
+        "Home: Fit world in window",
+        "Space: Pause/Resume",
+        "F: Fixed-point on/off",
+        "G: Grid/brute force neighbors",
+        "D: Tiled/tigr drawing",
+        "T: Write trace (with --trace)",
+        "C: Write checkpoint",
+        "B: Rewind (hold)",
+        "N: Step forward through rewound steps",
+        "Left click: Add boid",
+        "Right click: Add predator",
+        "Esc: Quit"
+    };
+    TPixel textColor = tigrRGB(255, 255, 255);
+    TPixel transparent = tigrRGBA(0, 0, 0, 0);
+
+    if (!overlay.instructions) {
+        int width = 0;
+        for (const char* instruction : instructions) {
+            width = std::max(width, tigrTextWidth(tfont, instruction));
+        }
+        int count = static_cast<int>(sizeof(instructions) / sizeof(instructions[0]));
+        overlay.instructions = tigrBitmap(width, count * 20);
+        tigrClear(overlay.instructions, transparent);
+        for (int i = 0; i < count; i++) {
+            int textWidth = tigrTextWidth(tfont, instructions[i]);
+            tigrPrint(overlay.instructions, tfont, width - textWidth, i * 20, textColor, instructions[i]);
+        }
+    }
+
+    bool changed = !overlay.sliders || overlay.values.size() != sliders.size();
+    for (size_t i = 0; !changed && i < sliders.size(); i++) {
+        changed = overlay.values[i] != sliders[i].currentValue;
+    }
+    if (!changed) return;
+
+    // The panel reaches from the origin to the end of the widest value label
+    int width = 1, height = 1;
+    for (const auto& slider : sliders) {
+        width = std::max(width, static_cast<int>(slider.x + slider.width + 10) + tigrTextWidth(tfont, "-000.000"));
+        height = std::max(height, static_cast<int>(slider.y + slider.height) + 1);
+    }
+    if (!overlay.sliders || overlay.sliders->w != width || overlay.sliders->h != height) {
+        if (overlay.sliders) tigrFree(overlay.sliders);
+        overlay.sliders = tigrBitmap(width, height);
+    }
+    tigrClear(overlay.sliders, transparent);
+    overlay.values.clear();
+    for (auto& slider : sliders) {
+        drawSlider(overlay.sliders, slider);
+        overlay.values.push_back(slider.currentValue);
+    }
+}
+
+// Composite a panel onto the screen: opaque pixels are copied, transparent ones skipped
+void blitPanel(Tigr* screen, const Tigr* panel, int dx, int dy) {
+    int yStart = std::max(0, -dy), yEnd = std::min(panel->h, screen->h - dy);
+    int xStart = std::max(0, -dx), xEnd = std::min(panel->w, screen->w - dx);
+    for (int y = yStart; y < yEnd; y++) {
+        const TPixel* src = panel->pix + y * panel->w;
+        TPixel* dst = screen->pix + (y + dy) * screen->w + dx;
+        for (int x = xStart; x < xEnd; x++) {
+            if (src[x].a == 255) {
+                dst[x] = src[x];
+            } else if (src[x].a != 0) {
+                blendPixel(dst[x], src[x]);
+            }
+        }
+    }
+}
+
+// Draw the sliders, and the instructions in the top right corner, from the cached panels
+void drawUi(Tigr* screen, std::vector<Slider>& sliders) {
+    updateUiOverlay(uiOverlay, sliders);
+    blitPanel(screen, uiOverlay.sliders, 0, 0);
+    blitPanel(screen, uiOverlay.instructions, screen->w - 10 - uiOverlay.instructions->w, 10);
+}
+
+// Draw a whole frame into the window or an offscreen bitmap, and time each part of it.
+// The flock goes down first, then wind particles and the UI on top.
+void renderFrame(Tigr* screen, const Flock& boids, const Flock& predators, std::vector<Slider>& sliders,
+                 RenderTimes& times) {
+    auto elapsedMs = [](std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    };
+    updateColors();
+
+    // Only the boids in view are drawn, and very large flocks fade into a density
+    // heatmap instead of individual boids
+    findVisibleBoids(boids, screen->w, screen->h, visibleBoids);
+    float lod = heatmapWeight(visibleBoids.size(), screen->w, screen->h);
+
+    if (lod >= 1.0f) {
+        uint64_t phaseStart = traceBegin();
+        auto start = std::chrono::steady_clock::now();
+        tigrClear(screen, tigrRGB(0, 0, 0));
+        drawObstacles(screen);
+        times.clear = elapsedMs(start);
+        traceEnd("clear", phaseStart);
+    } else if (RENDERER == RENDER_TILED) {
+        renderTiled(screen, boids, visibleBoids, predators, tileRenderer, times);
+    } else {
+        uint64_t phaseStart = traceBegin();
+        auto start = std::chrono::steady_clock::now();
+        tigrClear(screen, tigrRGB(0, 0, 0));
+        drawObstacles(screen);
+        times.clear = elapsedMs(start);
+        traceEnd("clear", phaseStart);
+
+        phaseStart = traceBegin();
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i : visibleBoids) {
+            drawTrail(screen, boids, i);
+        }
+        times.trails = elapsedMs(start);
+        traceEnd("trails", phaseStart);
+
+        phaseStart = traceBegin();
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i : visibleBoids) {
+            drawBoid(screen, loadBoid(boids, i));
+        }
+        times.boids = elapsedMs(start);
+        traceEnd("boids", phaseStart);
+
+        phaseStart = traceBegin();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < predators.size(); i++) {
+            drawPredator(screen, loadPredator(predators, i));
+        }
+        times.predators = elapsedMs(start);
+        traceEnd("predators", phaseStart);
+    }
+
+    uint64_t phaseStart;
+    std::chrono::steady_clock::time_point start;
+    if (lod > 0.0f) {
+        phaseStart = traceBegin();
+        start = std::chrono::steady_clock::now();
+        renderHeatmap(screen, boids, visibleBoids, heatmap, lod);
+        // Keep predators visible on top
+        for (size_t i = 0; i < predators.size(); i++) {
+            drawPredator(screen, loadPredator(predators, i));
+        }
+        times.heatmap = elapsedMs(start);
+        traceEnd("heatmap", phaseStart);
+    }
+
+    phaseStart = traceBegin();
+    start = std::chrono::steady_clock::now();
+    drawWindParticles(screen);
+    drawUi(screen, sliders);
+    times.ui = elapsedMs(start);
+    traceEnd("ui", phaseStart);
+}
+
+// Blend a pixel the way tigrPlot does
+void blendPixel(TPixel& dst, TPixel src) {
+    int xa = src.a + (src.a > 0);
+    int a = xa * xa;
+    dst.r += static_cast<unsigned char>((src.r - dst.r) * a >> 16);
+    dst.g += static_cast<unsigned char>((src.g - dst.g) * a >> 16);
+    dst.b += static_cast<unsigned char>((src.b - dst.b) * a >> 16);
+    dst.a += static_cast<unsigned char>((src.a - dst.a) * a >> 16);
+}
+
+// Bresenham line, blending only the pixels inside the clip rectangle. Steps exactly like
+// tigrLine: the start pixel is blended twice, the end pixel not at all, and error ties go
+// the same way, so blended trails come out identical.
+void drawLineClipped(Tigr* screen, int x0, int y0, int x1, int y1, TPixel color, const TileRect& clip) {
+    if (std::max(x0, x1) < clip.x0 || std::min(x0, x1) >= clip.x1 ||
+        std::max(y0, y1) < clip.y0 || std::min(y0, y1) >= clip.y1) {
+        return;
+    }
+    auto plot = [&](int x, int y) {
+        if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1) {
+            blendPixel(screen->pix[y * screen->w + x], color);
+        }
+    };
+    int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx - dy;
+    plot(x0, y0);
+    while (x0 != x1 || y0 != y1) {
+        plot(x0, y0);
+        int e2 = 2 * err;
+        if (e2 > -dy) { err -= dy; x0 += sx; }
+        if (e2 < dx) { err += dx; y0 += sy; }
+    }
+}
+
+// Bin the trail runs and bodies of the visible boids, and predators, into the tiles
+// their pixel bounds touch. The bounds are computed in parallel; the counting sort that
+// follows is stable, so each tile lists its items in draw order.
+void binTiles(TileRenderer& tiles, int width, int height, const Flock& boids,
+              const std::vector<uint32_t>& visible, const Flock& predators) {
+    updateSprites(sprites);
+    int ts = tiles.tileSize;
+    tiles.tilesX = (width + ts - 1) / ts;
+    tiles.tilesY = (height + ts - 1) / ts;
+    size_t numBoids = visible.size();
+
+    tiles.runStart.resize(numBoids + 1);
+    tiles.runStart[0] = 0;
+    for (size_t i = 0; i < numBoids; i++) {
+        size_t trailSize = boids.trailCount[visible[i]];
+        size_t segments = trailSize > 1 ? trailSize - 1 : 0;
+        tiles.runStart[i + 1] = tiles.runStart[i] + static_cast<uint32_t>((segments + TRAIL_RUN_LENGTH - 1) / TRAIL_RUN_LENGTH);
+    }
+    size_t numRuns = tiles.runStart[numBoids];
+    size_t numItems = numRuns + numBoids + predators.size();
+    tiles.runBoid.resize(numRuns);
+    tiles.runFirst.resize(numRuns);
+    tiles.heading.resize(numBoids + predators.size());
+    tiles.ranges.resize(numItems);
+
+    // Tile range of an inclusive pixel box, empty when it is off screen
+    auto tileRange = [&](int x0, int y0, int x1, int y1) {
+        if (x1 < 0 || y1 < 0 || x0 >= width || y0 >= height) return TileRange{1, 0, 0, 0};
+        return TileRange{static_cast<uint16_t>(std::max(x0, 0) / ts), static_cast<uint16_t>(std::max(y0, 0) / ts),
+                         static_cast<uint16_t>(std::min(x1, width - 1) / ts), static_cast<uint16_t>(std::min(y1, height - 1) / ts)};
+    };
+    auto bodyRange = [&](float x, float y, const Sprite& sprite) {
+        int cx = static_cast<int>(std::lround(toScreenX(x))), cy = static_cast<int>(std::lround(toScreenY(y)));
+        int reach = -sprite.top;
+        return tileRange(cx - reach, cy - reach, cx + reach, cy + reach);
+    };
+
+    parallelFor(workers, numBoids, 256, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t b = visible[i];
+            for (uint32_t run = tiles.runStart[i]; run < tiles.runStart[i + 1]; run++) {
+                size_t first = (run - tiles.runStart[i]) * TRAIL_RUN_LENGTH;
+                size_t last = std::min<size_t>(first + TRAIL_RUN_LENGTH, boids.trailCount[b] - 1);
+                int x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+                for (size_t p = first; p <= last; p++) {
+                    size_t point = trailPoint(boids, b, p);
+                    int px = static_cast<int>(toScreenX(boids.trailX[point]));
+                    int py = static_cast<int>(toScreenY(boids.trailY[point]));
+                    x0 = std::min(x0, px);
+                    y0 = std::min(y0, py);
+                    x1 = std::max(x1, px);
+                    y1 = std::max(y1, py);
+                }
+                tiles.runBoid[run] = b;
+                tiles.runFirst[run] = static_cast<uint32_t>(first);
+                tiles.ranges[run] = tileRange(x0, y0, x1, y1);
+            }
+            tiles.heading[i] = static_cast<uint8_t>(spriteHeading(boids.dx[b], boids.dy[b]));
+            tiles.ranges[numRuns + i] = bodyRange(boids.x[b], boids.y[b], sprites.boids[tiles.heading[i]]);
+        }
+    });
+    for (size_t i = 0; i < predators.size(); i++) {
+        tiles.heading[numBoids + i] = static_cast<uint8_t>(spriteHeading(predators.dx[i], predators.dy[i]));
+        tiles.ranges[numRuns + numBoids + i] = bodyRange(predators.x[i], predators.y[i],
+                                                         sprites.predators[tiles.heading[numBoids + i]]);
+    }
+
+    // Count the items in each tile, then place them
+    size_t numTiles = static_cast<size_t>(tiles.tilesX) * tiles.tilesY;
+    tiles.tileStart.assign(numTiles + 1, 0);
+    for (const TileRange& r : tiles.ranges) {
+        for (int ty = r.y0; ty <= r.y1; ty++) {
+            for (int tx = r.x0; tx <= r.x1; tx++) {
+                tiles.tileStart[ty * tiles.tilesX + tx + 1]++;
+            }
+        }
+    }
+    for (size_t t = 0; t < numTiles; t++) {
+        tiles.tileStart[t + 1] += tiles.tileStart[t];
+    }
+    tiles.cursor.assign(tiles.tileStart.begin(), tiles.tileStart.end() - 1);
+    tiles.items.resize(tiles.tileStart[numTiles]);
+    for (size_t item = 0; item < numItems; item++) {
+        const TileRange& r = tiles.ranges[item];
+        for (int ty = r.y0; ty <= r.y1; ty++) {
+            for (int tx = r.x0; tx <= r.x1; tx++) {
+                tiles.items[tiles.cursor[ty * tiles.tilesX + tx]++] = static_cast<uint32_t>(item);
+            }
+        }
+    }
+}
+
+// Draw the flock by screen tiles on the worker pool. Each tile is cleared, gets its part
+// of the obstacle layer, then its trails, boids and predators, writing straight into
+// the framebuffer: no two tiles share a pixel, so no locks are needed.
+void renderTiled(Tigr* screen, const Flock& boids, const std::vector<uint32_t>& visible,
+                 const Flock& predators, TileRenderer& tiles, RenderTimes& times) {
+    uint64_t phaseStart = traceBegin();
+    auto start = std::chrono::steady_clock::now();
+    binTiles(tiles, screen->w, screen->h, boids, visible, predators);
+    times.bin = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    traceEnd("bin", phaseStart);
+
+    phaseStart = traceBegin();
+    start = std::chrono::steady_clock::now();
+    size_t numRuns = tiles.runBoid.size();
+    size_t numBoids = visible.size();
+    const Tigr* layer = obstacleLayer;
+    TPixel background = tigrRGB(0, 0, 0);
+    parallelFor(workers, static_cast<size_t>(tiles.tilesX) * tiles.tilesY, 1, [&](size_t begin, size_t end, int) {
+        for (size_t t = begin; t < end; t++) {
+            int tx = static_cast<int>(t % tiles.tilesX), ty = static_cast<int>(t / tiles.tilesX);
+            TileRect clip = {tx * tiles.tileSize, ty * tiles.tileSize,
+                             std::min((tx + 1) * tiles.tileSize, screen->w), std::min((ty + 1) * tiles.tileSize, screen->h)};
+
+            // Clear and composite the obstacles
+            for (int y = clip.y0; y < clip.y1; y++) {
+                TPixel* row = screen->pix + y * screen->w;
+                std::fill(row + clip.x0, row + clip.x1, background);
+            }
+            compositeObstacles(screen, layer, clip);
+
+            for (uint32_t k = tiles.tileStart[t]; k < tiles.tileStart[t + 1]; k++) {
+                uint32_t item = tiles.items[k];
+                if (item < numRuns) {
+                    // Trail run, faded the same way as drawTrail
+                    uint32_t b = tiles.runBoid[item];
+                    size_t trailSize = boids.trailCount[b];
+                    size_t last = std::min<size_t>(tiles.runFirst[item] + TRAIL_RUN_LENGTH, trailSize - 1);
+                    for (size_t i = tiles.runFirst[item] + 1; i <= last; i++) {
+                        TPixel trailColor = boidColor;
+                        trailColor.a = static_cast<unsigned char>(175 * (i / static_cast<float>(trailSize)));
+                        size_t from = trailPoint(boids, b, i - 1), to = trailPoint(boids, b, i);
+                        drawLineClipped(screen,
+                                        static_cast<int>(toScreenX(boids.trailX[from])),
+                                        static_cast<int>(toScreenY(boids.trailY[from])),
+                                        static_cast<int>(toScreenX(boids.trailX[to])),
+                                        static_cast<int>(toScreenY(boids.trailY[to])),
+                                        trailColor, clip);
+                    }
+                } else if (item < numRuns + numBoids) {
+                    size_t i = item - numRuns;
+                    uint32_t b = visible[i];
+                    blitSprite(screen, sprites.boids[tiles.heading[i]], toScreenX(boids.x[b]), toScreenY(boids.y[b]), boidColor, clip);
+                } else {
+                    size_t i = item - numRuns - numBoids;
+                    blitSprite(screen, sprites.predators[tiles.heading[numBoids + i]], toScreenX(predators.x[i]),
+                               toScreenY(predators.y[i]), predatorColor, clip);
+                }
+            }
+        }
+    });
+    times.tiles = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    traceEnd("tiles", phaseStart);
+}
+
+// How much of the frame is heatmap: 0 below 3/4 of the threshold flock size or
+// density, 1 above 5/4 of it, and a smooth ramp in between
+float heatmapWeight(size_t numBoids, int width, int height) {
+    auto ramp = [](float value, float threshold) {
+        float t = std::clamp((value / threshold - 0.75f) * 2.0f, 0.0f, 1.0f);
+        return t * t * (3 - 2 * t);
+    };
+    float density = numBoids / std::max(1.0f, static_cast<float>(width) * height);
+    return std::max(ramp(static_cast<float>(numBoids), static_cast<float>(HEATMAP_BOIDS)), ramp(density, HEATMAP_DENSITY));
+}
+
+// Splat every visible boid into the heatmap, tone map it, and blend it over the frame by
+// weight. Brightness follows density, scaled to the mean density so the map never
+// saturates, and faster cells shift from the boid color toward white.
+void renderHeatmap(Tigr* screen, const Flock& boids, const std::vector<uint32_t>& visible, Heatmap& map,
+                   float weight) {
+    map.w = (screen->w + HEATMAP_CELL - 1) / HEATMAP_CELL;
+    map.h = (screen->h + HEATMAP_CELL - 1) / HEATMAP_CELL;
+    size_t numCells = static_cast<size_t>(map.w) * map.h;
+    int numBands = (map.h + HEATMAP_BAND - 1) / HEATMAP_BAND;
+    size_t numBoids = visible.size();
+    map.density.resize(numCells);
+    map.sumDx.resize(numCells);
+    map.sumDy.resize(numCells);
+    map.cellOf.resize(numBoids);
+    map.order.resize(numBoids);
+
+    // Cell of every boid, UINT32_MAX when off screen. Positions are gathered eight at a
+    // time so the index math runs as straight-line loops the compiler can vectorize.
+    const float cellScale = 1.0f / HEATMAP_CELL;
+    const int mapW = map.w, mapH = map.h;
+    parallelFor(workers, (numBoids + 7) / 8, 512, [&](size_t begin, size_t end, int) {
+        for (size_t block = begin; block < end; block++) {
+            size_t first = block * 8;
+            size_t n = std::min<size_t>(8, numBoids - first);
+            float x[8] = {}, y[8] = {};
+            int cx[8], cy[8];
+            for (size_t k = 0; k < n; k++) {
+                x[k] = toScreenX(boids.x[visible[first + k]]);
+                y[k] = toScreenY(boids.y[visible[first + k]]);
+            }
+            for (int k = 0; k < 8; k++) {
+                cx[k] = static_cast<int>(x[k] * cellScale);
+                cy[k] = static_cast<int>(y[k] * cellScale);
+            }
+            for (size_t k = 0; k < n; k++) {
+                bool inside = x[k] >= 0 && y[k] >= 0 && cx[k] < mapW && cy[k] < mapH;
+                map.cellOf[first + k] = inside ? static_cast<uint32_t>(cy[k] * mapW + cx[k]) : UINT32_MAX;
+            }
+        }
+    });
+
+    // Sort the boids into bands of cell rows
+    map.bandStart.assign(numBands + 1, 0);
+    for (size_t i = 0; i < numBoids; i++) {
+        if (map.cellOf[i] != UINT32_MAX) map.bandStart[map.cellOf[i] / mapW / HEATMAP_BAND + 1]++;
+    }
+    for (int b = 0; b < numBands; b++) {
+        map.bandStart[b + 1] += map.bandStart[b];
+    }
+    map.cursor.assign(map.bandStart.begin(), map.bandStart.end() - 1);
+    for (size_t i = 0; i < numBoids; i++) {
+        if (map.cellOf[i] != UINT32_MAX) map.order[map.cursor[map.cellOf[i] / mapW / HEATMAP_BAND]++] = static_cast<uint32_t>(i);
+    }
+    size_t numSplatted = map.bandStart[numBands];
+
+    // Splat each band on its own thread
+    parallelFor(workers, numBands, 1, [&](size_t begin, size_t end, int) {
+        for (size_t band = begin; band < end; band++) {
+            size_t cellBegin = band * HEATMAP_BAND * mapW;
+            size_t cellEnd = std::min(numCells, cellBegin + static_cast<size_t>(HEATMAP_BAND) * mapW);
+            std::fill(map.density.begin() + cellBegin, map.density.begin() + cellEnd, 0.0f);
+            std::fill(map.sumDx.begin() + cellBegin, map.sumDx.begin() + cellEnd, 0.0f);
+            std::fill(map.sumDy.begin() + cellBegin, map.sumDy.begin() + cellEnd, 0.0f);
+            for (uint32_t k = map.bandStart[band]; k < map.bandStart[band + 1]; k++) {
+                uint32_t b = visible[map.order[k]];
+                uint32_t cell = map.cellOf[map.order[k]];
+                map.density[cell] += 1.0f;
+                map.sumDx[cell] += boids.dx[b];
+                map.sumDy[cell] += boids.dy[b];
+            }
+        }
+    });
+
+    // Tone map and blend, band by band
+    float exposure = numSplatted > 0 ? numCells / (2.0f * numSplatted) : 0.0f;
+    TPixel base = hsvToRgb(HUE, 1.0f, 1.0f);
+    const float speedScale = 1.0f / world.params.speedLimit;
+    parallelFor(workers, numBands, 1, [&](size_t begin, size_t end, int) {
+        std::vector<float> brightness(mapW), whiteness(mapW);
+        for (size_t band = begin; band < end; band++) {
+            int cellRowEnd = std::min(mapH, static_cast<int>(band + 1) * HEATMAP_BAND);
+            for (int cy = static_cast<int>(band) * HEATMAP_BAND; cy < cellRowEnd; cy++) {
+                const float* density = &map.density[static_cast<size_t>(cy) * mapW];
+                const float* sumDx = &map.sumDx[static_cast<size_t>(cy) * mapW];
+                const float* sumDy = &map.sumDy[static_cast<size_t>(cy) * mapW];
+                for (int cx = 0; cx < mapW; cx++) {
+                    float inverse = 1.0f / std::max(density[cx], 1.0f);
+                    float speed = std::sqrt(sumDx[cx] * sumDx[cx] + sumDy[cx] * sumDy[cx]) * inverse * speedScale;
+                    brightness[cx] = 1.0f - std::exp(-density[cx] * exposure);
+                    whiteness[cx] = std::min(speed, 1.0f) * 0.75f;
+                }
+
+                int yEnd = std::min(screen->h, (cy + 1) * HEATMAP_CELL);
+                for (int y = cy * HEATMAP_CELL; y < yEnd; y++) {
+                    TPixel* row = screen->pix + static_cast<size_t>(y) * screen->w;
+                    for (int x = 0; x < screen->w; x++) {
+                        int cx = x / HEATMAP_CELL;
+                        if (density[cx] == 0.0f) {
+                            continue;
+                        }
+                        float b = brightness[cx], w = whiteness[cx];
+                        float heat[3] = {(base.r + (255 - base.r) * w) * b, (base.g + (255 - base.g) * w) * b,
+                                         (base.b + (255 - base.b) * w) * b};
+                        row[x].r = static_cast<unsigned char>(row[x].r + (heat[0] - row[x].r) * weight);
+                        row[x].g = static_cast<unsigned char>(row[x].g + (heat[1] - row[x].g) * weight);
+                        row[x].b = static_cast<unsigned char>(row[x].b + (heat[2] - row[x].b) * weight);
+                    }
+                }
+            }
+        }
+    });
+}
+
 void updateSlider(Slider& slider, int mouseX, int mouseY, bool mouseDown) {
     if (mouseDown && mouseX >= slider.x && mouseX <= slider.x + slider.width &&
         mouseY >= slider.y && mouseY <= slider.y + slider.height) {
@@ -641,76 +4283,58 @@ void updateSlider(Slider& slider, int mouseX, int mouseY, bool mouseDown) {
     }
 }
 
-void handleHotkeys(Tigr* screen, std::vector<Boid>& boids, std::vector<Predator>& predators) {
+void handleHotkeys(Tigr* screen, Flock& boids, Flock& predators) {
     if (tigrKeyDown(screen, 'R')) {
         resetSimulation(boids, predators);
     }
+    if (tigrKeyDown(screen, 'F')) {
+        if (world.params.mode == MODE_FIXED) {
+            world.params.mode = MODE_FLOAT;
+        } else if (fixedPointFits(world.params)) {
+            world.params.mode = MODE_FIXED;
+        } else {
+            printf("fixed-point mode supports worlds up to %d px a side\n", FIXED_MAX_WORLD_SIZE);
+        }
+    }
+    if (tigrKeyDown(screen, 'G')) {
+        world.params.backend = world.params.backend == BACKEND_GRID ? BACKEND_BRUTE_FORCE : BACKEND_GRID;
+    }
+    if (tigrKeyDown(screen, 'D')) {
+        RENDERER = RENDERER == RENDER_TILED ? RENDER_TIGR : RENDER_TILED;
+    }
+    if (tigrKeyDown(screen, 'C')) {
+        checkpoint(checkpointer, boids, predators);
+    }
     if (tigrKeyDown(screen, TK_LEFT)) {
-        nudgeBoids(screen, boids, -4, 0);
+        nudgeBoids(world, -4, 0);
     }
     if (tigrKeyDown(screen, TK_RIGHT)) {
-        nudgeBoids(screen, boids, 4, 0);
+        nudgeBoids(world, 4, 0);
     }
     if (tigrKeyDown(screen, TK_UP)) {
-        nudgeBoids(screen, boids, 0, -4);
+        nudgeBoids(world, 0, -4);
     }
     if (tigrKeyDown(screen, TK_DOWN)) {
-        nudgeBoids(screen, boids, 0, 4);
+        nudgeBoids(world, 0, 4);
     }
 }
 
-void resetSimulation(std::vector<Boid>& boids, std::vector<Predator>& predators) {
-    boids.clear();
-    boids.resize(0);
-    predators.clear();
-    predators.resize(0);
+void resetSimulation(Flock& boids, Flock& predators) {
+    resizeFlock(boids, 0);
+    resizeFlock(predators, 0);
+    clearTimeline(timeline);
 }
 
-void nudgeBoids(Tigr* screen, std::vector<Boid>& boids, float dx, float dy) {
-    static float windAngle = 0.0f;
-    static std::vector<std::pair<float, float>> windParticles;
-
-    // Update wind angle
-    windAngle += 0.05f;
-    if (windAngle > 2 * M_PI) windAngle -= 2 * M_PI;
-
-    // Calculate wind force
-    float windForceX = std::cos(windAngle) * 0.2f + dx;
-    float windForceY = std::sin(windAngle) * 0.2f + dy;
-
-    // Apply wind force to boids
-    for (auto& boid : boids) {
-        boid.dx += windForceX;
-        boid.dy += windForceY;
-        
-        // Add some turbulence
-        boid.dx += (dis(gen) - 0.5f) * 0.1f;
-        boid.dy += (dis(gen) - 0.5f) * 0.1f;
-    }
-
-    // Create new wind particles
-    if (windParticles.size() < 100) {
-        windParticles.push_back({dis(gen) * SCREEN_WIDTH, dis(gen) * SCREEN_HEIGHT});
-    }
-
-    // Update wind particles
-    for (auto& particle : windParticles) {
-        particle.first += windForceX * 5;
-        particle.second += windForceY * 5;
-
-        // Wrap particles around screen
-        if (particle.first < 0) particle.first += SCREEN_WIDTH;
-        if (particle.first > SCREEN_WIDTH) particle.first -= SCREEN_WIDTH;
-        if (particle.second < 0) particle.second += SCREEN_HEIGHT;
-        if (particle.second > SCREEN_HEIGHT) particle.second -= SCREEN_HEIGHT;
-    }
-
-    // Draw wind particles
-    for (const auto& particle : windParticles) {
+// Draw the wind particles if they moved this frame
+void drawWindParticles(Tigr* screen) {
+    if (!world.windParticles.shown) return;
+    world.windParticles.shown = false;
+    for (size_t i = 0; i < world.windParticles.x.size(); i++) {
         float lineLength = 50.0f;  // Adjust this value to change the length of the wind lines
-        float endX = particle.first + windForceX * lineLength;
-        float endY = particle.second + windForceY * lineLength;
-        tigrLine(screen, particle.first, particle.second, endX, endY, tigrRGBA(255, 255, 255, 100));
+        float endX = world.windParticles.x[i] + world.windParticles.vx[i] * lineLength;
+        float endY = world.windParticles.y[i] + world.windParticles.vy[i] * lineLength;
+        tigrLine(screen, toScreenX(world.windParticles.x[i]), toScreenY(world.windParticles.y[i]), toScreenX(endX), toScreenY(endY),
+                 tigrRGBA(255, 255, 255, 100));
     }
 }
 
@@ -737,4 +4361,10 @@ TPixel hsvToRgb(float h, float s, float v) {
         static_cast<unsigned char>((g + m) * 255),
         static_cast<unsigned char>((b + m) * 255)
     );
-}
\ No newline at end of file
+}
+
+// Boids take the slider hue, and predators the opposite side of the color wheel
+void updateColors() {
+    boidColor = hsvToRgb(HUE, 1.0f, 1.0f);
+    predatorColor = hsvToRgb(std::fmod(HUE + 0.5f, 1.0f), 1.0f, 1.0f);
+}
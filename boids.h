@@ -0,0 +1,95 @@
+//
+// By Benjamin Bassett (benonymity) on 9.1.24
+//
+// https://github.com/benonymity/boids
+//
+// C API of the flocking engine, for programs that embed it instead of running the
+// Tigr app. Build simulation.cpp into the host (or into a shared library) and include
+// this header. Calls on one world must not overlap, but separate worlds share no state
+// and can be stepped on different threads at the same time. A world stepped by more
+// than one thread runs its own workers inside boidsStep.
+//
+
+#ifndef BOIDS_H
+#define BOIDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct BoidsWorld BoidsWorld;
+
+// Parameters a host can change between steps
+typedef enum BoidsParam {
+    BOIDS_CENTERING_FACTOR,
+    BOIDS_AVOID_FACTOR,
+    BOIDS_MATCHING_FACTOR,
+    BOIDS_MARGIN,
+    BOIDS_TURN_FACTOR,
+    BOIDS_SPEED_LIMIT,
+    BOIDS_TRAIL_LENGTH,  // Trail points kept per boid, 0 (the default here) for none
+    BOIDS_WORLD_WIDTH,
+    BOIDS_WORLD_HEIGHT,
+    BOIDS_FIXED_POINT,   // 1 to step in 16.16 fixed point, for worlds up to 16384 px a side
+    BOIDS_NEIGHBOR_GRID  // 1 to find neighbors through the grid (the default), 0 to check every boid
+} BoidsParam;
+
+// Read-only view of the flock as structure-of-arrays. The pointers lead into the world's
+// own columns, so nothing is copied; they stay valid until the next call that steps,
+// spawns or despawns, or boidsFree.
+typedef struct BoidsState {
+    uint32_t step;
+    size_t numBoids;
+    const uint32_t* id;
+    const float* x;
+    const float* y;
+    const float* dx;
+    const float* dy;
+    size_t numPredators;
+    const uint32_t* predatorId;
+    const float* predatorX;
+    const float* predatorY;
+    const float* predatorDX;
+    const float* predatorDY;
+} BoidsState;
+
+// Create an empty world of width x height, stepped by `threads` threads (0 for one per
+// core, 1 to step on the calling thread with no workers)
+BoidsWorld* boidsCreate(int width, int height, uint64_t seed, int threads);
+void boidsFree(BoidsWorld* world);
+
+// Advance the world by `steps` steps
+void boidsStep(BoidsWorld* world, int steps);
+
+// Add `count` boids (or predators) at the given positions, or at seeded random positions
+// when x and y are NULL. Returns the id of the first; the rest follow in order.
+uint32_t boidsSpawn(BoidsWorld* world, size_t count, const float* x, const float* y);
+uint32_t boidsSpawnPredators(BoidsWorld* world, size_t count, const float* x, const float* y);
+
+// Remove the boids (or predators) with the given ids, keeping the order of the others.
+// Returns how many were removed.
+size_t boidsDespawn(BoidsWorld* world, const uint32_t* ids, size_t count);
+size_t boidsDespawnPredators(BoidsWorld* world, const uint32_t* ids, size_t count);
+
+// Set or read a parameter. boidsSetParam returns 0, and changes nothing, for an unknown
+// parameter or for a world size and fixed-point setting that together don't fit.
+int boidsSetParam(BoidsWorld* world, BoidsParam param, float value);
+float boidsGetParam(const BoidsWorld* world, BoidsParam param);
+
+// Use a w x h mask (nonzero is solid) stretched over the world as static obstacles, or
+// clear them with a NULL mask. Returns 0 if the mask is all solid or all empty.
+int boidsSetObstacles(BoidsWorld* world, const uint8_t* mask, int w, int h);
+
+BoidsState boidsState(const BoidsWorld* world);
+
+// Hash of every position and velocity, the same one the app prints after --headless
+uint64_t boidsChecksum(const BoidsWorld* world);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,15 +31,15 @@ if [[ "$OSTYPE" == "darwin"* ]]; then
         echo "Killed existing boids process"
     fi
 
-    g++ -std=c++17 ${name}.cpp tigr.c -o ${name} -framework OpenGL -framework Cocoa # I'll need this once I'm offically using Metal: -framework Foundation -framework Metal -framework MetalKit
+    g++ -std=c++17 -O2 -ffp-contract=off ${name}.cpp simulation.cpp tigr.c -o ${name} -framework OpenGL -framework Cocoa # I'll need this once I'm offically using Metal: -framework Foundation -framework Metal -framework MetalKit
     ./${name} &
 elif [[ "$OSTYPE" == "msys"* ]] || [[ "$OSTYPE" == "cygwin"* ]] || [[ "$OSTYPE" == "win"* ]]; then
     # Windows-specific compilation
-    g++ -std=c++17 ${name}.cpp tigr.c -o ${name} -s -lopengl32 -lgdi32
+    g++ -std=c++17 -O2 -ffp-contract=off ${name}.cpp simulation.cpp tigr.c -o ${name} -s -lopengl32 -lgdi32
     ./${name}
 else
     # For other operating systems, attempt a generic compilation
-    g++ -std=c++17 ${name}.cpp tigr.c -o ${name}
+    g++ -std=c++17 -O2 -ffp-contract=off ${name}.cpp simulation.cpp tigr.c -o ${name} -pthread
     ./${name}
 fi
 
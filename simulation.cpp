@@ -0,0 +1,1673 @@
+//
+// By Benjamin Bassett (benonymity) on 9.1.24
+//
+// https://github.com/benonymity/boids
+//
+
+#include "simulation.h"
+#include "boids.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <cstring>
+#include <fstream>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+// Tracing
+bool TRACING = false;
+const size_t TRACE_CAPACITY = 1 << 18;
+std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+std::mutex traceMutex;
+std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+int nextTraceThreadId = 0;
+
+// Owner of the calling thread's trace buffer, which lets go of it when the thread exits so
+// restarted worker pools don't keep the buffers of the threads they replaced
+struct TraceBufferOwner {
+    TraceBuffer* buffer = nullptr;
+    ~TraceBufferOwner();
+};
+thread_local TraceBufferOwner threadTraceBuffer;
+const std::thread::id mainThreadId = std::this_thread::get_id();
+
+// Hardware performance counters
+bool PERF_COUNTERS = false;
+std::mutex perfMutex;
+std::vector<PerfThreadCounters*> perfThreads;
+thread_local PerfThreadCounters perfCounters;
+
+// Philox4x32-10 counter-based generator: the output depends only on the key and the
+// counter, so any thread (or SIMD lane) can draw any random number in any order and
+// a run with the same seed is bit-reproducible
+void philox4x32(uint32_t key0, uint32_t key1, uint32_t counter[4]) {
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = static_cast<uint64_t>(M0) * counter[0];
+        uint64_t p1 = static_cast<uint64_t>(M1) * counter[2];
+        uint32_t c0 = static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key0;
+        uint32_t c2 = static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key1;
+        counter[0] = c0;
+        counter[1] = static_cast<uint32_t>(p1);
+        counter[2] = c2;
+        counter[3] = static_cast<uint32_t>(p0);
+        key0 += W0;
+        key1 += W1;
+    }
+}
+
+// Four uniform floats in [0, 1) for the given (seed, id, step, stream), at the world's
+// seed and current step
+void randomUniforms(const World& world, uint32_t id, RandomStream stream, float out[4]) {
+    uint32_t counter[4] = {id, world.step, static_cast<uint32_t>(stream), 0};
+    philox4x32(static_cast<uint32_t>(world.seed), static_cast<uint32_t>(world.seed >> 32), counter);
+    for (int i = 0; i < 4; i++) {
+        out[i] = (counter[i] >> 8) * (1.0f / 16777216.0f);
+    }
+}
+
+// Grow or shrink the flock to count entries; new ones are zeroed with empty trails
+void resizeFlock(Flock& flock, size_t count) {
+    flock.id.resize(count);
+    flock.x.resize(count);
+    flock.y.resize(count);
+    flock.dx.resize(count);
+    flock.dy.resize(count);
+    flock.trailHead.resize(count);
+    flock.trailCount.resize(count);
+    flock.trailX.resize(count * flock.trailCapacity);
+    flock.trailY.resize(count * flock.trailCapacity);
+}
+
+void addToFlock(Flock& flock, uint32_t id, float x, float y, float dx, float dy) {
+    size_t i = flock.size();
+    resizeFlock(flock, i + 1);
+    flock.id[i] = id;
+    flock.x[i] = x;
+    flock.y[i] = y;
+    flock.dx[i] = dx;
+    flock.dy[i] = dy;
+}
+
+Boid loadBoid(const Flock& flock, size_t i) {
+    return {flock.id[i], flock.x[i], flock.y[i], flock.dx[i], flock.dy[i]};
+}
+
+void storeBoid(Flock& flock, size_t i, const Boid& boid) {
+    flock.x[i] = boid.x;
+    flock.y[i] = boid.y;
+    flock.dx[i] = boid.dx;
+    flock.dy[i] = boid.dy;
+}
+
+Predator loadPredator(const Flock& flock, size_t i) {
+    return {flock.id[i], flock.x[i], flock.y[i], flock.dx[i], flock.dy[i]};
+}
+
+void storePredator(Flock& flock, size_t i, const Predator& predator) {
+    flock.x[i] = predator.x;
+    flock.y[i] = predator.y;
+    flock.dx[i] = predator.dx;
+    flock.dy[i] = predator.dy;
+}
+
+// Erase the entries whose id is in ids, keeping the rest (and their trails) in order
+size_t eraseIds(Flock& flock, const uint32_t* ids, size_t count) {
+    std::vector<uint32_t> sorted(ids, ids + count);
+    std::sort(sorted.begin(), sorted.end());
+    size_t before = flock.size(), kept = 0;
+    size_t capacity = flock.trailCapacity;
+    for (size_t i = 0; i < before; i++) {
+        if (std::binary_search(sorted.begin(), sorted.end(), flock.id[i])) continue;
+        if (kept != i) {
+            flock.id[kept] = flock.id[i];
+            storeBoid(flock, kept, loadBoid(flock, i));
+            flock.trailHead[kept] = flock.trailHead[i];
+            flock.trailCount[kept] = flock.trailCount[i];
+            std::copy_n(flock.trailX.begin() + i * capacity, capacity, flock.trailX.begin() + kept * capacity);
+            std::copy_n(flock.trailY.begin() + i * capacity, capacity, flock.trailY.begin() + kept * capacity);
+        }
+        kept++;
+    }
+    resizeFlock(flock, kept);
+    return before - kept;
+}
+
+// Offset in trailX and trailY of point k of boid i's trail, counting from the oldest
+size_t trailPoint(const Flock& flock, size_t i, size_t k) {
+    return i * flock.trailCapacity + (flock.trailHead[i] + k) % flock.trailCapacity;
+}
+
+// Lay the trails out again with room for capacity points each, keeping the newest
+void setTrailCapacity(Flock& flock, size_t capacity) {
+    if (capacity == flock.trailCapacity) return;
+    size_t n = flock.size();
+    std::vector<float> trailX(n * capacity), trailY(n * capacity);
+    for (size_t i = 0; i < n; i++) {
+        size_t count = flock.trailCount[i];
+        size_t keep = std::min(count, capacity);
+        for (size_t k = 0; k < keep; k++) {
+            size_t from = trailPoint(flock, i, count - keep + k);
+            trailX[i * capacity + k] = flock.trailX[from];
+            trailY[i * capacity + k] = flock.trailY[from];
+        }
+        flock.trailHead[i] = 0;
+        flock.trailCount[i] = static_cast<uint32_t>(keep);
+    }
+    flock.trailCapacity = capacity;
+    flock.trailX = std::move(trailX);
+    flock.trailY = std::move(trailY);
+}
+
+// Forget every trail, e.g. when replayed boids jump
+void clearTrails(Flock& flock) {
+    std::fill(flock.trailHead.begin(), flock.trailHead.end(), 0);
+    std::fill(flock.trailCount.begin(), flock.trailCount.end(), 0);
+}
+
+// Add count boids at random positions
+void initBoids(World& world, size_t count) {
+    Flock& boids = world.boids;
+    resizeFlock(boids, boids.size() + count);
+    for (size_t i = boids.size() - count; i < boids.size(); i++) {
+        float r[4];
+        boids.id[i] = world.nextBoidId++;
+        randomUniforms(world, boids.id[i], STREAM_BOID_SPAWN, r);
+        boids.x[i] = r[0] * world.params.width;
+        boids.y[i] = r[1] * world.params.height;
+        boids.dx[i] = r[2] * 10 - 5;
+        boids.dy[i] = r[3] * 10 - 5;
+    }
+}
+
+void addBoid(World& world, float x, float y) {
+    float r[4];
+    uint32_t id = world.nextBoidId++;
+    randomUniforms(world, id, STREAM_BOID_SPAWN, r);
+    addToFlock(world.boids, id, x, y, r[0] * 10 - 5, r[1] * 10 - 5);
+}
+
+void addPredator(World& world, float x, float y) {
+    float r[4];
+    uint32_t id = world.nextPredatorId++;
+    randomUniforms(world, id, STREAM_PREDATOR_SPAWN, r);
+    addToFlock(world.predators, id, x, y, r[0] * 10 - 5, r[1] * 10 - 5);
+}
+
+// Place predators at random positions, e.g. for headless runs
+void initPredators(World& world, int count) {
+    for (int i = 0; i < count; i++) {
+        float r[4];
+        randomUniforms(world, world.nextPredatorId, STREAM_PREDATOR_SPAWN, r);
+        addPredator(world, r[2] * world.params.width, r[3] * world.params.height);
+    }
+}
+
+// Empty the world and rewind it to step 0, keeping its parameters, seed and workers
+void resetWorld(World& world) {
+    World empty;
+    empty.params = world.params;
+    empty.seed = world.seed;
+    empty.workers = world.workers;
+    world = std::move(empty);
+}
+
+float distance(const Boid& b1, const Boid& b2) {
+    float dx = b1.x - b2.x;
+    float dy = b1.y - b2.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+float distance(const Predator& p1, const Predator& p2) {
+    float dx = p1.x - p2.x;
+    float dy = p1.y - p2.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+float distance(const Boid& boid, const Predator& predator) {
+    float dx = boid.x - predator.x;
+    float dy = boid.y - predator.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+void keepWithinBounds(Boid& boid, const WorldParams& params) {
+    if (boid.x < params.margin) boid.dx += params.turnFactor;
+    if (boid.x > params.width - params.margin) boid.dx -= params.turnFactor;
+    if (boid.y < params.margin) boid.dy += params.turnFactor;
+    if (boid.y > params.height - params.margin) boid.dy -= params.turnFactor;
+}
+
+// 1D squared Euclidean distance transform (Felzenszwalb & Huttenlocher), linear in n.
+// f holds 0 at seed cells and a large value elsewhere; samples are `spacing` apart.
+void distanceTransform1D(const float* f, float* d, int n, float spacing, std::vector<int>& v, std::vector<float>& z) {
+    v.resize(n);
+    z.resize(n + 1);
+    auto intersect = [&](int q, int p) {
+        float pq = q * spacing, pp = p * spacing;
+        return ((f[q] + pq * pq) - (f[p] + pp * pp)) / (2 * pq - 2 * pp);
+    };
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INFINITY;
+    z[1] = INFINITY;
+    for (int q = 1; q < n; q++) {
+        float s = intersect(q, v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = intersect(q, v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INFINITY;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        float pq = q * spacing;
+        while (z[k + 1] < pq) k++;
+        float pv = v[k] * spacing;
+        d[q] = (pq - pv) * (pq - pv) + f[v[k]];
+    }
+}
+
+// 2D squared distance to the nearest cell where seed[i] is true
+void distanceTransform2D(const std::vector<bool>& seed, int w, int h, float cellW, float cellH, std::vector<float>& out) {
+    const float far = 1e20f;
+    std::vector<float> tmp(w * h);
+    std::vector<float> f(std::max(w, h)), d(std::max(w, h));
+    std::vector<int> v;
+    std::vector<float> z;
+    out.assign(w * h, far);
+
+    // Columns first, then rows
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++) f[y] = seed[y * w + x] ? 0.0f : far;
+        distanceTransform1D(f.data(), d.data(), h, cellH, v, z);
+        for (int y = 0; y < h; y++) tmp[y * w + x] = d[y];
+    }
+    for (int y = 0; y < h; y++) {
+        distanceTransform1D(&tmp[y * w], &out[y * w], w, cellW, v, z);
+    }
+}
+
+// Precompute the signed distance field and gradient of a solid mask stretched over the
+// world, once, so sampling it costs the same however complex the obstacles are
+bool buildObstacleField(const std::vector<bool>& solid, int w, int h, const WorldParams& params, ObstacleField& field) {
+    std::vector<bool> empty(w * h);
+    bool anySolid = false, anyEmpty = false;
+    for (int i = 0; i < w * h; i++) {
+        empty[i] = !solid[i];
+        anySolid |= solid[i];
+        anyEmpty |= empty[i];
+    }
+    if (!anySolid || !anyEmpty) return false;
+
+    field.w = w;
+    field.h = h;
+    field.cellW = static_cast<float>(params.width) / w;
+    field.cellH = static_cast<float>(params.height) / h;
+
+    // Signed distance: distance to solid outside, minus distance to free space inside
+    std::vector<float> outside, inside;
+    distanceTransform2D(solid, w, h, field.cellW, field.cellH, outside);
+    distanceTransform2D(empty, w, h, field.cellW, field.cellH, inside);
+    field.sdf.resize(w * h);
+    for (int i = 0; i < w * h; i++) {
+        field.sdf[i] = std::sqrt(outside[i]) - std::sqrt(inside[i]);
+    }
+
+    // Gradient by central differences, normalized to a unit direction
+    field.gradX.assign(w * h, 0.0f);
+    field.gradY.assign(w * h, 0.0f);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, w - 1);
+            int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, h - 1);
+            float gx = (field.sdf[y * w + x1] - field.sdf[y * w + x0]) / ((x1 - x0) * field.cellW);
+            float gy = (field.sdf[y1 * w + x] - field.sdf[y0 * w + x]) / ((y1 - y0) * field.cellH);
+            float len = std::sqrt(gx * gx + gy * gy);
+            if (len > 0) {
+                field.gradX[y * w + x] = gx / len;
+                field.gradY[y * w + x] = gy / len;
+            }
+        }
+    }
+
+    // Fixed-point mode samples a 16.16 copy, so stepping never touches the floats
+    field.cellWFixed = toFixed(field.cellW);
+    field.cellHFixed = toFixed(field.cellH);
+    field.sdfFixed.resize(w * h);
+    field.gradXFixed.resize(w * h);
+    field.gradYFixed.resize(w * h);
+    for (int i = 0; i < w * h; i++) {
+        field.sdfFixed[i] = toFixed(field.sdf[i]);
+        field.gradXFixed[i] = toFixed(field.gradX[i]);
+        field.gradYFixed[i] = toFixed(field.gradY[i]);
+    }
+
+    return true;
+}
+
+// Bilinearly sample the signed distance and gradient at a world position
+void sampleObstacleField(const ObstacleField& field, float x, float y, float& dist, float& gradX, float& gradY) {
+    float fx = std::clamp(x / field.cellW - 0.5f, 0.0f, static_cast<float>(field.w - 1));
+    float fy = std::clamp(y / field.cellH - 0.5f, 0.0f, static_cast<float>(field.h - 1));
+    int x0 = std::min(static_cast<int>(fx), field.w - 2 < 0 ? 0 : field.w - 2);
+    int y0 = std::min(static_cast<int>(fy), field.h - 2 < 0 ? 0 : field.h - 2);
+    int x1 = std::min(x0 + 1, field.w - 1);
+    int y1 = std::min(y0 + 1, field.h - 1);
+    float tx = fx - x0, ty = fy - y0;
+
+    auto lerp2 = [&](const std::vector<float>& g) {
+        float a = g[y0 * field.w + x0] + (g[y0 * field.w + x1] - g[y0 * field.w + x0]) * tx;
+        float b = g[y1 * field.w + x0] + (g[y1 * field.w + x1] - g[y1 * field.w + x0]) * tx;
+        return a + (b - a) * ty;
+    };
+    dist = lerp2(field.sdf);
+    gradX = lerp2(field.gradX);
+    gradY = lerp2(field.gradY);
+}
+
+void avoidObstacles(Boid& boid, const ObstacleField& field) {
+    if (field.sdf.empty()) return;
+
+    float dist, gradX, gradY;
+    sampleObstacleField(field, boid.x, boid.y, dist, gradX, gradY);
+    if (dist < OBSTACLE_RANGE) {
+        // Push harder the closer we get, and harder still once inside
+        float push = (OBSTACLE_RANGE - dist) / OBSTACLE_RANGE;
+        boid.dx += gradX * push * OBSTACLE_AVOID_FACTOR;
+        boid.dy += gradY * push * OBSTACLE_AVOID_FACTOR;
+    }
+}
+
+void flyTowardsCenter(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params) {
+    float centerX = 0, centerY = 0;
+    int numNeighbors = 0;
+
+    for (const auto& otherBoid : boids) {
+        if (distance(boid, otherBoid) < VISUAL_RANGE) {
+            centerX += otherBoid.x;
+            centerY += otherBoid.y;
+            numNeighbors++;
+        }
+    }
+
+    if (numNeighbors) {
+        centerX /= numNeighbors;
+        centerY /= numNeighbors;
+        boid.dx += (centerX - boid.x) * params.centeringFactor;
+        boid.dy += (centerY - boid.y) * params.centeringFactor;
+    }
+}
+
+void avoidOthers(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params) {
+    const float minDistance = 20;
+    float moveX = 0, moveY = 0;
+
+    for (const auto& otherBoid : boids) {
+        if (&otherBoid != &boid) {
+            if (distance(boid, otherBoid) < minDistance) {
+                moveX += boid.x - otherBoid.x;
+                moveY += boid.y - otherBoid.y;
+            }
+        }
+    }
+
+    boid.dx += moveX * params.avoidFactor;
+    boid.dy += moveY * params.avoidFactor;
+}
+
+void avoidPredator(Boid& boid, const Flock& predators) {
+    float moveX = 0, moveY = 0;
+
+    for (size_t i = 0; i < predators.size(); i++) {
+        Predator predator = loadPredator(predators, i);
+        if (distance(boid, predator) < VISUAL_RANGE) {
+            moveX += boid.x - predator.x;
+            moveY += boid.y - predator.y;
+        }
+    }
+
+    boid.dx += moveX * PREDATOR_FEAR_FACTOR;
+    boid.dy += moveY * PREDATOR_FEAR_FACTOR;
+}
+
+void matchVelocity(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params) {
+    float avgDX = 0, avgDY = 0;
+    int numNeighbors = 0;
+
+    for (const auto& otherBoid : boids) {
+        if (distance(boid, otherBoid) < VISUAL_RANGE) {
+            avgDX += otherBoid.dx;
+            avgDY += otherBoid.dy;
+            numNeighbors++;
+        }
+    }
+
+    if (numNeighbors) {
+        avgDX /= numNeighbors;
+        avgDY /= numNeighbors;
+        boid.dx += (avgDX - boid.dx) * params.matchingFactor;
+        boid.dy += (avgDY - boid.dy) * params.matchingFactor;
+    }
+}
+
+void limitSpeed(Boid& boid, const WorldParams& params) {
+    float speed = std::sqrt(boid.dx * boid.dx + boid.dy * boid.dy);
+    if (speed > params.speedLimit) {
+        boid.dx = (boid.dx / speed) * params.speedLimit;
+        boid.dy = (boid.dy / speed) * params.speedLimit;
+    }
+}
+
+// Add boid i's position to its trail, dropping the oldest point once the ring is full
+void updateTrail(Flock& flock, size_t i) {
+    if (flock.trailCapacity == 0) return;
+    size_t slot;
+    if (flock.trailCount[i] < flock.trailCapacity) {
+        slot = trailPoint(flock, i, flock.trailCount[i]++);
+    } else {
+        slot = trailPoint(flock, i, 0);
+        flock.trailHead[i] = static_cast<uint32_t>((flock.trailHead[i] + 1) % flock.trailCapacity);
+    }
+    flock.trailX[slot] = flock.x[i];
+    flock.trailY[slot] = flock.y[i];
+}
+
+// Apply every rule to one boid, with its neighbors taken from the start-of-step snapshot
+void updateBoid(Boid& boid, const World& world) {
+    flyTowardsCenter(boid, world.boidSnapshot, world.params);
+    avoidOthers(boid, world.boidSnapshot, world.params);
+    avoidPredator(boid, world.predators);
+    matchVelocity(boid, world.boidSnapshot, world.params);
+    limitSpeed(boid, world.params);
+    keepWithinBounds(boid, world.params);
+    avoidObstacles(boid, world.obstacles);
+
+    boid.x += boid.dx;
+    boid.y += boid.dy;
+}
+
+// Start numThreads - 1 workers; the thread calling parallelFor does its share too
+void startWorkers(WorkerPool& pool, int numThreads) {
+    for (int i = 1; i < numThreads; i++) {
+        pool.threads.emplace_back([&pool, i]() {
+            setTraceThreadName("worker " + std::to_string(i));
+            openThreadPerfCounters();
+            int seen = 0;
+            while (true) {
+                std::unique_lock<std::mutex> lock(pool.mutex);
+                pool.wake.wait(lock, [&]() { return pool.quit || pool.generation != seen; });
+                if (pool.quit) return;
+                seen = pool.generation;
+                lock.unlock();
+
+                size_t chunk;
+                while ((chunk = pool.nextChunk.fetch_add(1)) * pool.chunkSize < pool.jobCount) {
+                    size_t begin = chunk * pool.chunkSize;
+                    size_t end = std::min(begin + pool.chunkSize, pool.jobCount);
+                    uint64_t taskStart = traceBegin();
+                    pool.job(begin, end, i);
+                    traceEnd("task", taskStart, begin, end - begin);
+                }
+
+                lock.lock();
+                if (--pool.running == 0) pool.finished.notify_one();
+            }
+        });
+    }
+}
+
+void stopWorkers(WorkerPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.quit = true;
+    }
+    pool.wake.notify_all();
+    for (auto& thread : pool.threads) {
+        thread.join();
+    }
+    pool.threads.clear();
+    pool.quit = false;
+}
+
+// Call fn(begin, end, thread) on chunks of [0, count) across the pool and wait for all of them.
+// Which thread gets which chunk varies from run to run, so fn must not depend on it.
+void parallelFor(WorkerPool& pool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)>& fn) {
+    if (pool.threads.empty() || count <= chunkSize) {
+        if (count) fn(0, count, 0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.job = fn;
+        pool.jobCount = count;
+        pool.chunkSize = chunkSize;
+        pool.nextChunk = 0;
+        pool.running = static_cast<int>(pool.threads.size());
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+
+    size_t chunk;
+    while ((chunk = pool.nextChunk.fetch_add(1)) * chunkSize < count) {
+        size_t begin = chunk * chunkSize;
+        size_t end = std::min(begin + chunkSize, count);
+        uint64_t taskStart = traceBegin();
+        fn(begin, end, 0);
+        traceEnd("task", taskStart, begin, end - begin);
+    }
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finished.wait(lock, [&]() { return pool.running == 0; });
+}
+
+// The pool a world steps on. Worlds without one step on the calling thread, through a
+// pool with no threads, which parallelFor never writes to.
+WorkerPool& worldWorkers(World& world) {
+    static WorkerPool callingThread;
+    return world.workers ? *world.workers : callingThread;
+}
+
+// Advance the whole simulation by one step. Every boid reads its neighbors from a snapshot
+// taken before the step and sums them in index order on a single thread, so the result
+// is bit-identical no matter how many threads run or how the boids are chunked.
+void stepSimulation(World& world) {
+    Flock& boids = world.boids;
+    auto updateStart = std::chrono::steady_clock::now();
+    uint64_t traceStart = traceBegin();
+    PerfSample countersBefore = readPerfCounters();
+    setTrailCapacity(boids, static_cast<size_t>(std::max(0.0f, world.params.trailLength)));
+    if (world.params.mode == MODE_FIXED) {
+        updateFixedBoids(world);
+    } else {
+        world.boidSnapshot.resize(boids.size());
+        for (size_t i = 0; i < boids.size(); i++) {
+            world.boidSnapshot[i] = loadBoid(boids, i);
+        }
+        bool useGrid = world.params.backend == BACKEND_GRID;
+        if (useGrid) {
+            buildGrid(world.grid, world.boidSnapshot, VISUAL_RANGE, world.params.width, world.params.height);
+        }
+        parallelFor(worldWorkers(world), boids.size(), 64, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; i++) {
+                Boid boid = world.boidSnapshot[i];
+                if (useGrid) {
+                    updateBoidGrid(boid, world);
+                } else {
+                    updateBoid(boid, world);
+                }
+                storeBoid(boids, i, boid);
+                updateTrail(boids, i);
+            }
+        });
+    }
+    auto predatorStart = std::chrono::steady_clock::now();
+    world.phaseTimes.updateCounters = perfDelta(countersBefore, readPerfCounters());
+    traceEnd("update boids", traceStart);
+
+    // Predators are few and chase each other, so they stay serial
+    traceStart = traceBegin();
+    if (world.params.mode == MODE_FIXED) {
+        updateFixedPredators(world);
+    } else {
+        for (size_t i = 0; i < world.predators.size(); i++) {
+            updatePredator(world, i);
+        }
+    }
+    world.step++;
+    traceEnd("update predators", traceStart);
+
+    auto end = std::chrono::steady_clock::now();
+    world.phaseTimes.update = std::chrono::duration<double, std::milli>(predatorStart - updateStart).count();
+    world.phaseTimes.predators = std::chrono::duration<double, std::milli>(end - predatorStart).count();
+}
+
+// Bucket boids into square cells of cellSize. Boids outside the world go into the edge
+// cells, which keeps every neighbor within one cell of the boid looking for it.
+void buildGrid(SpatialGrid& grid, const std::vector<Boid>& boids, float cellSize, int width, int height) {
+    grid.cellSize = cellSize;
+    grid.w = std::max(1, static_cast<int>(std::ceil(width / cellSize)));
+    grid.h = std::max(1, static_cast<int>(std::ceil(height / cellSize)));
+    size_t numCells = static_cast<size_t>(grid.w) * grid.h;
+    size_t n = boids.size();
+
+    grid.cellStart.assign(numCells + 1, 0);
+    grid.cellOf.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        int cx = std::clamp(static_cast<int>(std::floor(boids[i].x / cellSize)), 0, grid.w - 1);
+        int cy = std::clamp(static_cast<int>(std::floor(boids[i].y / cellSize)), 0, grid.h - 1);
+        grid.cellOf[i] = cy * grid.w + cx;
+        grid.cellStart[grid.cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < numCells; c++) {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+
+    // Stable, so boids within a cell stay in index order
+    grid.cursor.assign(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.indices.resize(n);
+    grid.x.resize(n);
+    grid.y.resize(n);
+    grid.dx.resize(n);
+    grid.dy.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t slot = grid.cursor[grid.cellOf[i]]++;
+        grid.indices[slot] = static_cast<uint32_t>(i);
+        grid.x[slot] = boids[i].x;
+        grid.y[slot] = boids[i].y;
+        grid.dx[slot] = boids[i].dx;
+        grid.dy[slot] = boids[i].dy;
+    }
+}
+
+// flyTowardsCenter, avoidOthers, avoidPredator and matchVelocity with the three neighbor
+// rules fused into one scan of the 3x3 cells around the boid. Cells and the boids in
+// them are visited in a fixed order, so the result is still independent of threading.
+void applyNeighborRulesGrid(Boid& boid, const SpatialGrid& grid, const Flock& predators,
+                            const WorldParams& params) {
+    const float minDistance = 20;
+    const float visualRange2 = VISUAL_RANGE * VISUAL_RANGE;
+    const float minDistance2 = minDistance * minDistance;
+    float centerX = 0, centerY = 0, avgDX = 0, avgDY = 0, moveX = 0, moveY = 0;
+    int numNeighbors = 0;
+
+    int cx = std::clamp(static_cast<int>(std::floor(boid.x / grid.cellSize)), 0, grid.w - 1);
+    int cy = std::clamp(static_cast<int>(std::floor(boid.y / grid.cellSize)), 0, grid.h - 1);
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid.h - 1); y++) {
+        for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid.w - 1); x++) {
+            int cell = y * grid.w + x;
+            for (uint32_t k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+                float offX = boid.x - grid.x[k];
+                float offY = boid.y - grid.y[k];
+                float dist2 = offX * offX + offY * offY;
+                if (dist2 < visualRange2) {
+                    centerX += grid.x[k];
+                    centerY += grid.y[k];
+                    avgDX += grid.dx[k];
+                    avgDY += grid.dy[k];
+                    numNeighbors++;
+                    if (dist2 < minDistance2) {
+                        moveX += offX;
+                        moveY += offY;
+                    }
+                }
+            }
+        }
+    }
+
+    // Fly towards center
+    if (numNeighbors) {
+        centerX /= numNeighbors;
+        centerY /= numNeighbors;
+        boid.dx += (centerX - boid.x) * params.centeringFactor;
+        boid.dy += (centerY - boid.y) * params.centeringFactor;
+    }
+
+    // Avoid others
+    boid.dx += moveX * params.avoidFactor;
+    boid.dy += moveY * params.avoidFactor;
+
+    avoidPredator(boid, predators);
+
+    // Match velocity
+    if (numNeighbors) {
+        avgDX /= numNeighbors;
+        avgDY /= numNeighbors;
+        boid.dx += (avgDX - boid.dx) * params.matchingFactor;
+        boid.dy += (avgDY - boid.dy) * params.matchingFactor;
+    }
+}
+
+// Same rules as updateBoid, finding neighbors through the grid
+void updateBoidGrid(Boid& boid, const World& world) {
+    applyNeighborRulesGrid(boid, world.grid, world.predators, world.params);
+    limitSpeed(boid, world.params);
+    keepWithinBounds(boid, world.params);
+    avoidObstacles(boid, world.obstacles);
+
+    boid.x += boid.dx;
+    boid.y += boid.dy;
+}
+
+// FNV-1a hash over the exact bits of every position and velocity
+uint64_t simulationChecksum(const Flock& boids, const Flock& predators) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 4; i++) {
+            hash ^= (bits >> (i * 8)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (size_t i = 0; i < boids.size(); i++) {
+        mix(boids.x[i]); mix(boids.y[i]); mix(boids.dx[i]); mix(boids.dy[i]);
+    }
+    for (size_t i = 0; i < predators.size(); i++) {
+        mix(predators.x[i]); mix(predators.y[i]); mix(predators.dx[i]); mix(predators.dy[i]);
+    }
+    return hash;
+}
+
+// 16.16 fixed-point helpers
+const int FIXED_SHIFT = 16;
+const int32_t FIXED_ONE = 1 << FIXED_SHIFT;
+
+int32_t toFixed(float value) {
+    return static_cast<int32_t>(std::lround(value * FIXED_ONE));
+}
+
+// Whether the world is small enough for fixed-point positions
+bool fixedPointFits(const WorldParams& params) {
+    return params.width <= FIXED_MAX_WORLD_SIZE && params.height <= FIXED_MAX_WORLD_SIZE;
+}
+
+float fromFixed(int32_t value) {
+    return static_cast<float>(value) / FIXED_ONE;
+}
+
+int32_t fixedMul(int64_t a, int32_t b) {
+    return static_cast<int32_t>((a * b) >> FIXED_SHIFT);
+}
+
+// Bilinearly sample the 16.16 copy of the obstacle field at a 16.16 position, the same
+// way sampleObstacleField samples the floats
+void sampleObstacleFieldFixed(const ObstacleField& field, int32_t x, int32_t y, int32_t& dist, int32_t& gradX,
+                              int32_t& gradY) {
+    int64_t fx = (static_cast<int64_t>(x) << FIXED_SHIFT) / field.cellWFixed - FIXED_ONE / 2;
+    int64_t fy = (static_cast<int64_t>(y) << FIXED_SHIFT) / field.cellHFixed - FIXED_ONE / 2;
+    fx = std::clamp<int64_t>(fx, 0, static_cast<int64_t>(field.w - 1) << FIXED_SHIFT);
+    fy = std::clamp<int64_t>(fy, 0, static_cast<int64_t>(field.h - 1) << FIXED_SHIFT);
+    int x0 = std::min(static_cast<int>(fx >> FIXED_SHIFT), field.w - 2 < 0 ? 0 : field.w - 2);
+    int y0 = std::min(static_cast<int>(fy >> FIXED_SHIFT), field.h - 2 < 0 ? 0 : field.h - 2);
+    int x1 = std::min(x0 + 1, field.w - 1);
+    int y1 = std::min(y0 + 1, field.h - 1);
+    int32_t tx = static_cast<int32_t>(fx - (static_cast<int64_t>(x0) << FIXED_SHIFT));
+    int32_t ty = static_cast<int32_t>(fy - (static_cast<int64_t>(y0) << FIXED_SHIFT));
+
+    auto lerp2 = [&](const std::vector<int32_t>& g) {
+        int64_t a = g[y0 * field.w + x0] + fixedMul(static_cast<int64_t>(g[y0 * field.w + x1]) - g[y0 * field.w + x0], tx);
+        int64_t b = g[y1 * field.w + x0] + fixedMul(static_cast<int64_t>(g[y1 * field.w + x1]) - g[y1 * field.w + x0], tx);
+        return static_cast<int32_t>(a + fixedMul(b - a, ty));
+    };
+    dist = lerp2(field.sdfFixed);
+    gradX = lerp2(field.gradXFixed);
+    gradY = lerp2(field.gradYFixed);
+}
+
+// Integer square root, so the speed limit needs no floating point either
+uint32_t isqrt64(uint64_t n) {
+    uint64_t result = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > n) bit >>= 2;
+    while (bit) {
+        if (n >= result + bit) {
+            n -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return static_cast<uint32_t>(result);
+}
+
+// The slider parameters converted to fixed point once per step
+struct FixedParams {
+    int64_t visualRange2, minDistance2;
+    int32_t centering, avoid, matching, fear;
+    int32_t speedLimit, margin, turn;
+    int32_t width, height;
+    int32_t obstacleRange, obstacleAvoid;
+};
+
+// Grid cell of a 16.16 coordinate, clamped to the grid like buildGrid does
+int fixedGridCell(int32_t value, int32_t cellSize, int cells) {
+    return value < 0 ? 0 : std::min(value / cellSize, cells - 1);
+}
+
+// Bucket the fixed-point snapshot by grid cell, keeping index order within each cell
+void buildFixedGrid(FixedGrid& grid, const std::vector<FixedBoid>& boids, int32_t cellSize, int width, int height) {
+    grid.cellSize = cellSize;
+    grid.w = std::max<int>(1, static_cast<int>(((static_cast<int64_t>(width) << FIXED_SHIFT) + cellSize - 1) / cellSize));
+    grid.h = std::max<int>(1, static_cast<int>(((static_cast<int64_t>(height) << FIXED_SHIFT) + cellSize - 1) / cellSize));
+    size_t numCells = static_cast<size_t>(grid.w) * grid.h;
+    size_t n = boids.size();
+
+    grid.cellStart.assign(numCells + 1, 0);
+    grid.cellOf.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        int cx = fixedGridCell(boids[i].x, cellSize, grid.w);
+        int cy = fixedGridCell(boids[i].y, cellSize, grid.h);
+        grid.cellOf[i] = cy * grid.w + cx;
+        grid.cellStart[grid.cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < numCells; c++) {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+
+    grid.cursor.assign(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.boids.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        grid.boids[grid.cursor[grid.cellOf[i]]++] = boids[i];
+    }
+}
+
+// Same rules as updateBoid in integer arithmetic. Neighbor sums are taken in one pass
+// and then applied in the same order as the float rules. With a grid, only the 3x3 cells
+// around the boid are visited; the sums are integers, so the result is the same.
+void updateFixedBoid(FixedBoid& boid, const std::vector<FixedBoid>& boids, const FixedGrid* grid,
+                     const std::vector<FixedBoid>& predators, const FixedParams& params, const ObstacleField& obstacles) {
+    int64_t centerX = 0, centerY = 0, avgDX = 0, avgDY = 0, moveX = 0, moveY = 0;
+    int64_t numNeighbors = 0;
+    auto visit = [&](const FixedBoid& other) {
+        int64_t offX = static_cast<int64_t>(boid.x) - other.x;
+        int64_t offY = static_cast<int64_t>(boid.y) - other.y;
+        int64_t dist2 = offX * offX + offY * offY;
+        if (dist2 < params.visualRange2) {
+            centerX += other.x;
+            centerY += other.y;
+            avgDX += other.dx;
+            avgDY += other.dy;
+            numNeighbors++;
+            if (dist2 < params.minDistance2) {
+                moveX += offX;
+                moveY += offY;
+            }
+        }
+    };
+    if (grid) {
+        int cx = fixedGridCell(boid.x, grid->cellSize, grid->w);
+        int cy = fixedGridCell(boid.y, grid->cellSize, grid->h);
+        for (int y = std::max(0, cy - 1); y <= std::min(grid->h - 1, cy + 1); y++) {
+            for (int x = std::max(0, cx - 1); x <= std::min(grid->w - 1, cx + 1); x++) {
+                int cell = y * grid->w + x;
+                for (uint32_t k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+                    visit(grid->boids[k]);
+                }
+            }
+        }
+    } else {
+        for (const auto& other : boids) visit(other);
+    }
+
+    // Fly towards center
+    if (numNeighbors) {
+        boid.dx += fixedMul(centerX / numNeighbors - boid.x, params.centering);
+        boid.dy += fixedMul(centerY / numNeighbors - boid.y, params.centering);
+    }
+
+    // Avoid others
+    boid.dx += fixedMul(moveX, params.avoid);
+    boid.dy += fixedMul(moveY, params.avoid);
+
+    // Avoid predators
+    int64_t fleeX = 0, fleeY = 0;
+    for (const auto& predator : predators) {
+        int64_t offX = static_cast<int64_t>(boid.x) - predator.x;
+        int64_t offY = static_cast<int64_t>(boid.y) - predator.y;
+        if (offX * offX + offY * offY < params.visualRange2) {
+            fleeX += offX;
+            fleeY += offY;
+        }
+    }
+    boid.dx += fixedMul(fleeX, params.fear);
+    boid.dy += fixedMul(fleeY, params.fear);
+
+    // Match velocity
+    if (numNeighbors) {
+        boid.dx += fixedMul(avgDX / numNeighbors - boid.dx, params.matching);
+        boid.dy += fixedMul(avgDY / numNeighbors - boid.dy, params.matching);
+    }
+
+    // Limit speed
+    int64_t speed2 = static_cast<int64_t>(boid.dx) * boid.dx + static_cast<int64_t>(boid.dy) * boid.dy;
+    if (speed2 > static_cast<int64_t>(params.speedLimit) * params.speedLimit) {
+        int64_t speed = isqrt64(static_cast<uint64_t>(speed2));
+        boid.dx = static_cast<int32_t>(static_cast<int64_t>(boid.dx) * params.speedLimit / speed);
+        boid.dy = static_cast<int32_t>(static_cast<int64_t>(boid.dy) * params.speedLimit / speed);
+    }
+
+    // Keep within bounds
+    if (boid.x < params.margin) boid.dx += params.turn;
+    if (boid.x > params.width - params.margin) boid.dx -= params.turn;
+    if (boid.y < params.margin) boid.dy += params.turn;
+    if (boid.y > params.height - params.margin) boid.dy -= params.turn;
+
+    // Avoid obstacles, pushing harder the closer we get
+    if (!obstacles.sdfFixed.empty()) {
+        int32_t dist, gradX, gradY;
+        sampleObstacleFieldFixed(obstacles, boid.x, boid.y, dist, gradX, gradY);
+        if (dist < params.obstacleRange) {
+            int64_t push = ((static_cast<int64_t>(params.obstacleRange) - dist) << FIXED_SHIFT) / params.obstacleRange;
+            boid.dx += fixedMul(fixedMul(push, gradX), params.obstacleAvoid);
+            boid.dy += fixedMul(fixedMul(push, gradY), params.obstacleAvoid);
+        }
+    }
+
+    boid.x += boid.dx;
+    boid.y += boid.dy;
+}
+
+// Bring the fixed-point state in line with the float copies the rest of the program sees.
+// An entry whose float copy no longer matches (new, reset or nudged) is quantized again.
+void syncFixedState(std::vector<FixedBoid>& fixed, const Flock& flock) {
+    fixed.resize(flock.size());
+    for (size_t i = 0; i < flock.size(); i++) {
+        if (fromFixed(fixed[i].x) != flock.x[i] || fromFixed(fixed[i].y) != flock.y[i] ||
+            fromFixed(fixed[i].dx) != flock.dx[i] || fromFixed(fixed[i].dy) != flock.dy[i]) {
+            fixed[i] = {toFixed(flock.x[i]), toFixed(flock.y[i]), toFixed(flock.dx[i]), toFixed(flock.dy[i])};
+        }
+    }
+}
+
+// Step the flock in fixed point. The fixed-point state is authoritative; boids hold a float
+// copy for drawing.
+void updateFixedBoids(World& world) {
+    Flock& boids = world.boids;
+    std::vector<FixedBoid>& fixedBoids = world.fixedBoids;
+    syncFixedState(fixedBoids, boids);
+    world.fixedSnapshot = fixedBoids;
+    syncFixedState(world.fixedPredators, world.predators);
+    const std::vector<FixedBoid>& fixedPredators = world.fixedPredators;
+
+    FixedParams params;
+    int64_t visualRange = toFixed(VISUAL_RANGE), minDistance = toFixed(20.0f);
+    params.visualRange2 = visualRange * visualRange;
+    params.minDistance2 = minDistance * minDistance;
+    params.centering = toFixed(world.params.centeringFactor);
+    params.avoid = toFixed(world.params.avoidFactor);
+    params.matching = toFixed(world.params.matchingFactor);
+    params.fear = toFixed(PREDATOR_FEAR_FACTOR);
+    params.speedLimit = toFixed(world.params.speedLimit);
+    params.margin = toFixed(world.params.margin);
+    params.turn = toFixed(world.params.turnFactor);
+    params.width = toFixed(static_cast<float>(world.params.width));
+    params.height = toFixed(static_cast<float>(world.params.height));
+    params.obstacleRange = toFixed(OBSTACLE_RANGE);
+    params.obstacleAvoid = toFixed(OBSTACLE_AVOID_FACTOR);
+
+    const FixedGrid* grid = nullptr;
+    if (world.params.backend == BACKEND_GRID) {
+        buildFixedGrid(world.fixedGrid, world.fixedSnapshot, toFixed(VISUAL_RANGE), world.params.width, world.params.height);
+        grid = &world.fixedGrid;
+    }
+
+    parallelFor(worldWorkers(world), boids.size(), 64, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            updateFixedBoid(fixedBoids[i], world.fixedSnapshot, grid, fixedPredators, params, world.obstacles);
+            boids.x[i] = fromFixed(fixedBoids[i].x);
+            boids.y[i] = fromFixed(fixedBoids[i].y);
+            boids.dx[i] = fromFixed(fixedBoids[i].dx);
+            boids.dy[i] = fromFixed(fixedBoids[i].dy);
+            updateTrail(boids, i);
+        }
+    });
+}
+
+// Same rules as updatePredator in integer arithmetic, so predators don't bring floats back
+// into a fixed-point run. Like the float version, each predator sees the boids after this
+// step's update and the predators before it already moved.
+void updateFixedPredators(World& world) {
+    std::vector<FixedBoid>& predators = world.fixedPredators;
+    syncFixedState(predators, world.predators);
+    if (world.fixedBoids.empty()) return;
+
+    int64_t detectionRange = toFixed(150.0f), minDistance = toFixed(30.0f);
+    int64_t detectionRange2 = detectionRange * detectionRange, minDistance2 = minDistance * minDistance;
+    int32_t chase = toFixed(0.05f), jitter = toFixed(0.3f), avoid = toFixed(0.1f);
+    int32_t speedLimit = toFixed(3.0f);
+    int32_t width = toFixed(static_cast<float>(world.params.width));
+    int32_t height = toFixed(static_cast<float>(world.params.height));
+
+    for (size_t p = 0; p < predators.size(); p++) {
+        FixedBoid& predator = predators[p];
+
+        // Chase the center of mass of nearby boids
+        int64_t centerX = 0, centerY = 0, nearbyCount = 0;
+        for (const auto& boid : world.fixedBoids) {
+            int64_t offX = static_cast<int64_t>(boid.x) - predator.x;
+            int64_t offY = static_cast<int64_t>(boid.y) - predator.y;
+            if (offX * offX + offY * offY < detectionRange2) {
+                centerX += boid.x;
+                centerY += boid.y;
+                nearbyCount++;
+            }
+        }
+        if (nearbyCount > 0) {
+            predator.dx += fixedMul(centerX / nearbyCount - predator.x, chase);
+            predator.dy += fixedMul(centerY / nearbyCount - predator.y, chase);
+        }
+
+        // Random jitter; the uniforms have 24 bits, so they convert to 16.16 exactly
+        float r[4];
+        randomUniforms(world, world.predators.id[p], STREAM_PREDATOR_JITTER, r);
+        predator.dx += fixedMul(2 * static_cast<int64_t>(toFixed(r[0])) - FIXED_ONE, jitter);
+        predator.dy += fixedMul(2 * static_cast<int64_t>(toFixed(r[1])) - FIXED_ONE, jitter);
+
+        // Limit speed
+        int64_t speed2 = static_cast<int64_t>(predator.dx) * predator.dx + static_cast<int64_t>(predator.dy) * predator.dy;
+        if (speed2 > static_cast<int64_t>(speedLimit) * speedLimit) {
+            int64_t speed = isqrt64(static_cast<uint64_t>(speed2));
+            predator.dx = static_cast<int32_t>(static_cast<int64_t>(predator.dx) * speedLimit / speed);
+            predator.dy = static_cast<int32_t>(static_cast<int64_t>(predator.dy) * speedLimit / speed);
+        }
+
+        // Avoid other predators
+        for (size_t q = 0; q < predators.size(); q++) {
+            if (q == p) continue;
+            int64_t offX = static_cast<int64_t>(predator.x) - predators[q].x;
+            int64_t offY = static_cast<int64_t>(predator.y) - predators[q].y;
+            if (offX * offX + offY * offY < minDistance2) {
+                predator.dx += fixedMul(offX, avoid);
+                predator.dy += fixedMul(offY, avoid);
+            }
+        }
+
+        predator.x += predator.dx;
+        predator.y += predator.dy;
+
+        // Bounce off the edges of the world
+        if (predator.x < 0) {
+            predator.x = 0;
+            predator.dx = -predator.dx;
+        } else if (predator.x > width) {
+            predator.x = width;
+            predator.dx = -predator.dx;
+        }
+        if (predator.y < 0) {
+            predator.y = 0;
+            predator.dy = -predator.dy;
+        } else if (predator.y > height) {
+            predator.y = height;
+            predator.dy = -predator.dy;
+        }
+
+        world.predators.x[p] = fromFixed(predator.x);
+        world.predators.y[p] = fromFixed(predator.y);
+        world.predators.dx[p] = fromFixed(predator.dx);
+        world.predators.dy[p] = fromFixed(predator.dy);
+    }
+}
+
+FlockStats computeFlockStats(const Flock& boids) {
+    FlockStats stats = {0, 0, 0};
+    if (boids.empty()) return stats;
+
+    float headingX = 0, headingY = 0;
+    for (size_t i = 0; i < boids.size(); i++) {
+        float speed = std::sqrt(boids.dx[i] * boids.dx[i] + boids.dy[i] * boids.dy[i]);
+        stats.meanSpeed += speed;
+        if (speed > 0) {
+            headingX += boids.dx[i] / speed;
+            headingY += boids.dy[i] / speed;
+        }
+    }
+    stats.polarization = std::sqrt(headingX * headingX + headingY * headingY) / boids.size();
+    stats.meanSpeed /= boids.size();
+
+    if (boids.size() > 1) {
+        for (size_t i = 0; i < boids.size(); i++) {
+            Boid boid = loadBoid(boids, i);
+            float nearest = INFINITY;
+            for (size_t j = 0; j < boids.size(); j++) {
+                if (j != i) nearest = std::min(nearest, distance(boid, loadBoid(boids, j)));
+            }
+            stats.meanNeighborDistance += nearest;
+        }
+        stats.meanNeighborDistance /= boids.size();
+    }
+    return stats;
+}
+
+// Whether two runs of a scene behave alike, for modes that can't match step by step
+bool flockStatsAgree(const FlockStats& reference, const FlockStats& other) {
+    auto relative = [](float a, float b) { return std::fabs(a - b) / std::max(std::fabs(a), 1e-6f); };
+    return std::fabs(reference.polarization - other.polarization) <= 0.1f &&
+           relative(reference.meanSpeed, other.meanSpeed) <= 0.1f &&
+           relative(reference.meanNeighborDistance, other.meanNeighborDistance) <= 0.15f;
+}
+
+#ifdef __linux__
+PerfThreadCounters::~PerfThreadCounters() {
+    if (leader < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(perfMutex);
+        perfThreads.erase(std::remove(perfThreads.begin(), perfThreads.end(), this), perfThreads.end());
+    }
+    for (int i = 0; i < 4; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+#else
+PerfThreadCounters::~PerfThreadCounters() {}
+#endif
+
+// Open cycle, instruction, LLC miss and branch miss counters for the calling thread.
+// If the kernel won't give us counters (no permission, a VM, not Linux) they quietly
+// stay off, and so do any events the hardware doesn't have.
+void openThreadPerfCounters() {
+#ifdef __linux__
+    if (!PERF_COUNTERS || perfCounters.leader >= 0) return;
+    const uint64_t configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < 4; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, perfCounters.leader, 0));
+        if (fd < 0) continue;
+        if (perfCounters.leader < 0) perfCounters.leader = fd;
+        perfCounters.fds[i] = fd;
+        perfCounters.slots[i] = perfCounters.numOpen++;
+    }
+    if (perfCounters.leader >= 0) {
+        std::lock_guard<std::mutex> lock(perfMutex);
+        perfThreads.push_back(&perfCounters);
+    }
+#endif
+}
+
+// Current counter totals of every thread; valid is false when nothing could be counted
+PerfSample readPerfCounters() {
+    PerfSample sample;
+#ifdef __linux__
+    if (!PERF_COUNTERS) return sample;
+    std::lock_guard<std::mutex> lock(perfMutex);
+    for (PerfThreadCounters* counters : perfThreads) {
+        uint64_t values[5];
+        if (read(counters->leader, values, sizeof(values)) < static_cast<ssize_t>(sizeof(uint64_t))) continue;
+        auto value = [&](int i) { return counters->slots[i] >= 0 ? values[1 + counters->slots[i]] : 0; };
+        sample.cycles += value(0);
+        sample.instructions += value(1);
+        sample.cacheMisses += value(2);
+        sample.branchMisses += value(3);
+        sample.valid = true;
+    }
+#endif
+    return sample;
+}
+
+// Counts between two samples
+PerfSample perfDelta(const PerfSample& before, const PerfSample& after) {
+    PerfSample delta;
+    if (!before.valid || !after.valid) return delta;
+    delta.valid = true;
+    delta.cycles = after.cycles - before.cycles;
+    delta.instructions = after.instructions - before.instructions;
+    delta.cacheMisses = after.cacheMisses - before.cacheMisses;
+    delta.branchMisses = after.branchMisses - before.branchMisses;
+    return delta;
+}
+
+// Add a delta to a running total
+void addPerfSample(PerfSample& total, const PerfSample& delta) {
+    if (!delta.valid) return;
+    total.valid = true;
+    total.cycles += delta.cycles;
+    total.instructions += delta.instructions;
+    total.cacheMisses += delta.cacheMisses;
+    total.branchMisses += delta.branchMisses;
+}
+
+void printPerfSummary(const char* phase, const PerfSample& counters, double boidSteps) {
+    if (!counters.valid || boidSteps <= 0) {
+        printf("%-7s hardware counters unavailable\n", phase);
+        return;
+    }
+    printf("%-7s %9.1f cycles %9.1f instructions  IPC %5.2f %8.3f LLC misses %8.3f branch misses per boid-step\n",
+           phase, counters.cycles / boidSteps, counters.instructions / boidSteps,
+           counters.cycles ? static_cast<double>(counters.instructions) / counters.cycles : 0.0,
+           counters.cacheMisses / boidSteps, counters.branchMisses / boidSteps);
+}
+
+uint64_t traceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+// The calling thread's trace buffer, registered the first time the thread traces anything
+TraceBuffer* traceBuffer() {
+    if (!threadTraceBuffer.buffer) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        traceBuffers.push_back(std::make_unique<TraceBuffer>());
+        TraceBuffer* buffer = traceBuffers.back().get();
+        buffer->threadId = nextTraceThreadId++;
+        buffer->threadName = std::this_thread::get_id() == mainThreadId ? "main" : "thread";
+        threadTraceBuffer.buffer = buffer;
+    }
+    return threadTraceBuffer.buffer;
+}
+
+// Free the buffer of an exiting thread right away if it is empty, or after the next
+// writeTrace otherwise
+TraceBufferOwner::~TraceBufferOwner() {
+    if (!buffer) return;
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (buffer->events.empty()) {
+        traceBuffers.erase(std::remove_if(traceBuffers.begin(), traceBuffers.end(),
+                                          [&](const std::unique_ptr<TraceBuffer>& b) { return b.get() == buffer; }),
+                           traceBuffers.end());
+    } else {
+        buffer->retired = true;
+    }
+}
+
+void setTraceThreadName(const std::string& name) {
+    if (TRACING) traceBuffer()->threadName = name;
+}
+
+// Start of a traced span, or 0 when tracing is off
+uint64_t traceBegin() {
+    return TRACING ? traceNow() : 0;
+}
+
+void traceEnd(const char* name, uint64_t start, int64_t first, int64_t count) {
+    if (!TRACING) return;
+    TraceBuffer* buffer = traceBuffer();
+    if (buffer->events.size() < TRACE_CAPACITY) {
+        buffer->events.push_back({name, start, traceNow(), first, count});
+    } else {
+        buffer->dropped++;
+    }
+}
+
+// Write every thread's events as Chrome trace JSON (open it in chrome://tracing or Perfetto)
+// and empty the buffers. Only call this while the workers are idle.
+bool writeTrace(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    std::ofstream file(fileName);
+    if (!file) return false;
+
+    size_t dropped = 0;
+    bool firstEvent = true;
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (auto& buffer : traceBuffers) {
+        file << (firstEvent ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+             << buffer->threadId << ", \"args\": {\"name\": \"" << buffer->threadName << "\"}}";
+        firstEvent = false;
+        for (const TraceEvent& event : buffer->events) {
+            file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->threadId
+                 << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << (event.end - event.start) / 1000.0;
+            if (event.first >= 0) {
+                file << ", \"args\": {\"first\": " << event.first << ", \"count\": " << event.count << "}";
+            }
+            file << "}";
+        }
+        dropped += buffer->dropped;
+        buffer->events.clear();
+        buffer->dropped = 0;
+    }
+    traceBuffers.erase(std::remove_if(traceBuffers.begin(), traceBuffers.end(),
+                                      [](const std::unique_ptr<TraceBuffer>& buffer) { return buffer->retired; }),
+                       traceBuffers.end());
+    file << "\n]}\n";
+    if (dropped) std::cerr << "Trace buffers were full, dropped " << dropped << " events" << std::endl;
+    return static_cast<bool>(file);
+}
+
+// Move predator `index`. Predators are stepped in order, so each sees the ones before it
+// after they moved.
+void updatePredator(World& world, size_t index) {
+    const Flock& boids = world.boids;
+    Flock& predators = world.predators;
+    if (boids.empty()) return;
+    Predator predator = loadPredator(predators, index);
+
+    // Calculate the center of mass of nearby boids
+    float centerX = 0, centerY = 0;
+    int nearbyCount = 0;
+    float detectionRange = 150.0f; // Adjust this value as needed
+
+    for (size_t i = 0; i < boids.size(); i++) {
+        float offX = boids.x[i] - predator.x;
+        float offY = boids.y[i] - predator.y;
+        float dist = std::sqrt(offX * offX + offY * offY);
+        if (dist < detectionRange) {
+            centerX += boids.x[i];
+            centerY += boids.y[i];
+            nearbyCount++;
+        }
+    }
+
+    if (nearbyCount > 0) {
+        centerX /= nearbyCount;
+        centerY /= nearbyCount;
+
+        float chaseFactor = 0.05f; // Reduced from 0.1f to make predator slower
+        predator.dx += (centerX - predator.x) * chaseFactor;
+        predator.dy += (centerY - predator.y) * chaseFactor;
+    }
+
+    // Add randomness to predator movement
+    float randomFactor = 0.3f; // Reduced from 0.5f to make movement less erratic
+    float r[4];
+    randomUniforms(world, predator.id, STREAM_PREDATOR_JITTER, r);
+    predator.dx += (r[0] * 2 - 1) * randomFactor;
+    predator.dy += (r[1] * 2 - 1) * randomFactor;
+
+    // Limit predator speed
+    float speed = std::sqrt(predator.dx * predator.dx + predator.dy * predator.dy);
+    float predatorSpeedLimit = 3.0f; // Reduced from 10.0f to make predator much slower
+    if (speed > predatorSpeedLimit) {
+        predator.dx = (predator.dx / speed) * predatorSpeedLimit;
+        predator.dy = (predator.dy / speed) * predatorSpeedLimit;
+    }
+
+    // Avoid other predators
+    const float minDistance = 30.0f;
+    for (size_t i = 0; i < predators.size(); i++) {
+        if (i != index) {
+            Predator otherPredator = loadPredator(predators, i);
+            float dist = distance(otherPredator, predator);
+            if (dist < minDistance) {
+                float avoidFactor = 0.1f;
+                predator.dx += (predator.x - otherPredator.x) * avoidFactor;
+                predator.dy += (predator.y - otherPredator.y) * avoidFactor;
+            }
+        }
+    }
+
+    // Update predator position
+    predator.x += predator.dx;
+    predator.y += predator.dy;
+
+    // Keep predator within screen bounds
+    if (predator.x < 0) {
+        predator.x = 0;
+        predator.dx *= -1;
+    } else if (predator.x > world.params.width) {
+        predator.x = world.params.width;
+        predator.dx *= -1;
+    }
+    if (predator.y < 0) {
+        predator.y = 0;
+        predator.dy *= -1;
+    } else if (predator.y > world.params.height) {
+        predator.y = world.params.height;
+        predator.dy *= -1;
+    }
+    storePredator(predators, index, predator);
+}
+
+// Smooth 3D value noise in [-1, 1], used as the potential for the curl noise
+float valueNoise(float x, float y, float z) {
+    auto hash = [](int x, int y, int z) {
+        uint32_t h = static_cast<uint32_t>(x) * 374761393u + static_cast<uint32_t>(y) * 668265263u + static_cast<uint32_t>(z) * 2246822519u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return static_cast<float>(h ^ (h >> 16)) / 4294967295.0f * 2.0f - 1.0f;
+    };
+    auto smooth = [](float t) { return t * t * (3 - 2 * t); };
+
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    int z0 = static_cast<int>(std::floor(z));
+    float tx = smooth(x - x0), ty = smooth(y - y0), tz = smooth(z - z0);
+
+    float result[2];
+    for (int k = 0; k < 2; k++) {
+        float a = hash(x0, y0, z0 + k) + (hash(x0 + 1, y0, z0 + k) - hash(x0, y0, z0 + k)) * tx;
+        float b = hash(x0, y0 + 1, z0 + k) + (hash(x0 + 1, y0 + 1, z0 + k) - hash(x0, y0 + 1, z0 + k)) * tx;
+        result[k] = a + (b - a) * ty;
+    }
+    return result[0] + (result[1] - result[0]) * tz;
+}
+
+// Recompute the wind vector at every grid node: a rotating breeze plus curl noise gusts.
+// The curl of a scalar potential is divergence free, so the gusts swirl instead of
+// piling boids up in sinks.
+void updateWindField(WindField& field, const WorldParams& params, float dt) {
+    field.time += dt;
+    field.w = static_cast<int>(std::ceil(params.width / WIND_CELL_SIZE)) + 1;
+    field.h = static_cast<int>(std::ceil(params.height / WIND_CELL_SIZE)) + 1;
+    field.vx.resize(field.w * field.h);
+    field.vy.resize(field.w * field.h);
+
+    // Sample the potential on the nodes (with a one node border for the differences)
+    const float noiseScale = 0.25f; // Noise features span about four cells
+    const float noiseSpeed = 0.1f;
+    int pw = field.w + 2, ph = field.h + 2;
+    std::vector<float> potential(pw * ph);
+    for (int y = 0; y < ph; y++) {
+        for (int x = 0; x < pw; x++) {
+            potential[y * pw + x] = valueNoise((x - 1) * noiseScale, (y - 1) * noiseScale, field.time * noiseSpeed);
+        }
+    }
+
+    float breezeX = std::cos(field.time) * WIND_STRENGTH;
+    float breezeY = std::sin(field.time) * WIND_STRENGTH;
+    for (int y = 0; y < field.h; y++) {
+        for (int x = 0; x < field.w; x++) {
+            int p = (y + 1) * pw + (x + 1);
+            float dPdx = (potential[p + 1] - potential[p - 1]) * 0.5f / noiseScale;
+            float dPdy = (potential[p + pw] - potential[p - pw]) * 0.5f / noiseScale;
+            field.vx[y * field.w + x] = breezeX + dPdy * WIND_TURBULENCE;
+            field.vy[y * field.w + x] = breezeY - dPdx * WIND_TURBULENCE;
+        }
+    }
+}
+
+// Bilinearly sample the wind at a world position
+void sampleWindField(const WindField& field, float x, float y, float& vx, float& vy) {
+    float fx = std::clamp(x / WIND_CELL_SIZE, 0.0f, static_cast<float>(field.w - 1));
+    float fy = std::clamp(y / WIND_CELL_SIZE, 0.0f, static_cast<float>(field.h - 1));
+    int x0 = std::min(static_cast<int>(fx), std::max(field.w - 2, 0));
+    int y0 = std::min(static_cast<int>(fy), std::max(field.h - 2, 0));
+    int x1 = std::min(x0 + 1, field.w - 1);
+    int y1 = std::min(y0 + 1, field.h - 1);
+    float tx = fx - x0, ty = fy - y0;
+
+    auto lerp2 = [&](const std::vector<float>& g) {
+        float a = g[y0 * field.w + x0] + (g[y0 * field.w + x1] - g[y0 * field.w + x0]) * tx;
+        float b = g[y1 * field.w + x0] + (g[y1 * field.w + x1] - g[y1 * field.w + x0]) * tx;
+        return a + (b - a) * ty;
+    };
+    vx = lerp2(field.vx);
+    vy = lerp2(field.vy);
+}
+
+void nudgeBoids(World& world, float dx, float dy) {
+    WindField& wind = world.wind;
+    WindParticles& windParticles = world.windParticles;
+    int width = world.params.width, height = world.params.height;
+
+    // Advance the wind field
+    updateWindField(wind, world.params, 0.05f);
+
+    // Apply the local wind plus the nudge to boids
+    Flock& boids = world.boids;
+    for (size_t i = 0; i < boids.size(); i++) {
+        float windX, windY;
+        sampleWindField(wind, boids.x[i], boids.y[i], windX, windY);
+        boids.dx[i] += windX + dx;
+        boids.dy[i] += windY + dy;
+    }
+
+    // Create new wind particles
+    if (windParticles.x.size() < MAX_WIND_PARTICLES) {
+        float r[4];
+        randomUniforms(world, static_cast<uint32_t>(windParticles.x.size()), STREAM_WIND, r);
+        windParticles.x.push_back(r[0] * width);
+        windParticles.y.push_back(r[1] * height);
+        windParticles.vx.push_back(0.0f);
+        windParticles.vy.push_back(0.0f);
+    }
+
+    // Update wind particles
+    size_t numParticles = windParticles.x.size();
+    for (size_t i = 0; i < numParticles; i++) {
+        float windX, windY;
+        sampleWindField(wind, windParticles.x[i], windParticles.y[i], windX, windY);
+        windParticles.vx[i] = windX + dx;
+        windParticles.vy[i] = windY + dy;
+        windParticles.x[i] += windParticles.vx[i] * 5;
+        windParticles.y[i] += windParticles.vy[i] * 5;
+
+        // Wrap particles around screen
+        if (windParticles.x[i] < 0) windParticles.x[i] += width;
+        if (windParticles.x[i] > width) windParticles.x[i] -= width;
+        if (windParticles.y[i] < 0) windParticles.y[i] += height;
+        if (windParticles.y[i] > height) windParticles.y[i] -= height;
+    }
+    windParticles.shown = true;
+}
+
+// C API (boids.h). Each handle owns a World and, when it steps on more than one thread,
+// its own worker pool, so separate handles share nothing but the trace and perf counters.
+struct BoidsWorld {
+    World world;
+    WorkerPool workers;
+};
+
+// Where each float parameter lives in WorldParams, in BoidsParam order
+float WorldParams::* const paramSlots[] = {
+    &WorldParams::centeringFactor,
+    &WorldParams::avoidFactor,
+    &WorldParams::matchingFactor,
+    &WorldParams::margin,
+    &WorldParams::turnFactor,
+    &WorldParams::speedLimit,
+    &WorldParams::trailLength,
+};
+const int NUM_PARAM_SLOTS = sizeof(paramSlots) / sizeof(paramSlots[0]);
+
+extern "C" {
+
+BoidsWorld* boidsCreate(int width, int height, uint64_t seed, int threads) {
+    BoidsWorld* handle = new BoidsWorld();
+    World& world = handle->world;
+    world.params.width = std::max(1, width);
+    world.params.height = std::max(1, height);
+    world.params.trailLength = 0.0f;
+    world.seed = seed;
+    if (threads != 1) {
+        int count = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        startWorkers(handle->workers, count);
+        world.workers = &handle->workers;
+    }
+    return handle;
+}
+
+void boidsFree(BoidsWorld* handle) {
+    if (!handle) return;
+    stopWorkers(handle->workers);
+    delete handle;
+}
+
+void boidsStep(BoidsWorld* handle, int steps) {
+    for (int i = 0; i < steps; i++) {
+        stepSimulation(handle->world);
+    }
+}
+
+uint32_t boidsSpawn(BoidsWorld* handle, size_t count, const float* x, const float* y) {
+    World& world = handle->world;
+    uint32_t first = world.nextBoidId;
+    if (x && y) {
+        for (size_t i = 0; i < count; i++) addBoid(world, x[i], y[i]);
+    } else {
+        initBoids(world, count);
+    }
+    return first;
+}
+
+uint32_t boidsSpawnPredators(BoidsWorld* handle, size_t count, const float* x, const float* y) {
+    World& world = handle->world;
+    uint32_t first = world.nextPredatorId;
+    if (x && y) {
+        for (size_t i = 0; i < count; i++) addPredator(world, x[i], y[i]);
+    } else {
+        initPredators(world, static_cast<int>(count));
+    }
+    return first;
+}
+
+size_t boidsDespawn(BoidsWorld* handle, const uint32_t* ids, size_t count) {
+    return eraseIds(handle->world.boids, ids, count);
+}
+
+size_t boidsDespawnPredators(BoidsWorld* handle, const uint32_t* ids, size_t count) {
+    return eraseIds(handle->world.predators, ids, count);
+}
+
+int boidsSetParam(BoidsWorld* handle, BoidsParam param, float value) {
+    WorldParams& params = handle->world.params;
+    if (param >= 0 && param < NUM_PARAM_SLOTS) {
+        params.*paramSlots[param] = value;
+        return 1;
+    }
+    // Fixed point can't hold positions in very large worlds, so refuse any change that
+    // would leave a fixed-point world too big
+    WorldParams changed = params;
+    switch (param) {
+    case BOIDS_WORLD_WIDTH: changed.width = std::max(1, static_cast<int>(value)); break;
+    case BOIDS_WORLD_HEIGHT: changed.height = std::max(1, static_cast<int>(value)); break;
+    case BOIDS_FIXED_POINT: changed.mode = value != 0 ? MODE_FIXED : MODE_FLOAT; break;
+    case BOIDS_NEIGHBOR_GRID: changed.backend = value != 0 ? BACKEND_GRID : BACKEND_BRUTE_FORCE; break;
+    default: return 0;
+    }
+    if (changed.mode == MODE_FIXED && !fixedPointFits(changed)) return 0;
+    params = changed;
+    return 1;
+}
+
+float boidsGetParam(const BoidsWorld* handle, BoidsParam param) {
+    const WorldParams& params = handle->world.params;
+    if (param >= 0 && param < NUM_PARAM_SLOTS) return params.*paramSlots[param];
+    switch (param) {
+    case BOIDS_WORLD_WIDTH: return static_cast<float>(params.width);
+    case BOIDS_WORLD_HEIGHT: return static_cast<float>(params.height);
+    case BOIDS_FIXED_POINT: return params.mode == MODE_FIXED ? 1.0f : 0.0f;
+    case BOIDS_NEIGHBOR_GRID: return params.backend == BACKEND_GRID ? 1.0f : 0.0f;
+    default: return 0.0f;
+    }
+}
+
+int boidsSetObstacles(BoidsWorld* handle, const uint8_t* mask, int w, int h) {
+    World& world = handle->world;
+    world.obstacles = ObstacleField();
+    if (!mask || w <= 0 || h <= 0) return 1;
+    std::vector<bool> solid(static_cast<size_t>(w) * h);
+    for (size_t i = 0; i < solid.size(); i++) solid[i] = mask[i] != 0;
+    if (buildObstacleField(solid, w, h, world.params, world.obstacles)) return 1;
+    world.obstacles = ObstacleField();
+    return 0;
+}
+
+// Pointers straight into the world's columns, so nothing is copied
+BoidsState boidsState(const BoidsWorld* handle) {
+    const World& world = handle->world;
+    BoidsState state;
+    state.step = world.step;
+    state.numBoids = world.boids.size();
+    state.id = world.boids.id.data();
+    state.x = world.boids.x.data();
+    state.y = world.boids.y.data();
+    state.dx = world.boids.dx.data();
+    state.dy = world.boids.dy.data();
+    state.numPredators = world.predators.size();
+    state.predatorId = world.predators.id.data();
+    state.predatorX = world.predators.x.data();
+    state.predatorY = world.predators.y.data();
+    state.predatorDX = world.predators.dx.data();
+    state.predatorDY = world.predators.dy.data();
+    return state;
+}
+
+uint64_t boidsChecksum(const BoidsWorld* handle) {
+    return simulationChecksum(handle->world.boids, handle->world.predators);
+}
+
+}
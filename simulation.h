@@ -0,0 +1,321 @@
+//
+// By Benjamin Bassett (benonymity) on 9.1.24
+//
+// https://github.com/benonymity/boids
+//
+// The flocking engine: boids, predators, obstacles, wind, the neighbor grid and the
+// worker pool, with no windowing or drawing. boids.cpp is one client of it, and other
+// programs embed it through the C API in boids.h.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boid structure (one boid's position and velocity, copied out of the flock while its
+// rules run)
+struct Boid {
+    uint32_t id;
+    float x, y;
+    float dx, dy;
+};
+
+// Predator structure
+struct Predator {
+    uint32_t id;
+    float x, y;
+    float dx, dy;
+};
+
+// Flock structure (boids or predators as structure of arrays, so renderers and hosts read
+// the columns in place). Each boid's trail is a ring of trailCapacity points at offset
+// i * trailCapacity in trailX and trailY, with trailCount[i] in use and the oldest at
+// trailHead[i]. Predators keep no trails.
+struct Flock {
+    std::vector<uint32_t> id;
+    std::vector<float> x, y;
+    std::vector<float> dx, dy;
+    size_t trailCapacity = 0;
+    std::vector<uint32_t> trailHead, trailCount;
+    std::vector<float> trailX, trailY;
+
+    size_t size() const { return id.size(); }
+    bool empty() const { return id.empty(); }
+};
+
+// Obstacle field structure (signed distance and gradient sampled on a grid)
+struct ObstacleField {
+    int w = 0, h = 0;
+    float cellW = 1.0f, cellH = 1.0f;
+    std::vector<float> sdf;          // Negative inside obstacles, world units
+    std::vector<float> gradX, gradY; // Normalized direction away from obstacles
+    int32_t cellWFixed = 0, cellHFixed = 0; // The same field rounded to 16.16 for fixed-point mode
+    std::vector<int32_t> sdfFixed, gradXFixed, gradYFixed;
+};
+
+// Wind field structure (flow vectors on a coarse grid of nodes)
+struct WindField {
+    int w = 0, h = 0;
+    float time = 0.0f;
+    std::vector<float> vx, vy;
+};
+
+// Wind particle structure (structure of arrays, advected by the wind field)
+struct WindParticles {
+    std::vector<float> x, y;
+    std::vector<float> vx, vy;
+    bool shown = false; // Moved this frame, so draw them
+};
+
+// Fixed-point boid structure (16.16 positions and velocities)
+struct FixedBoid {
+    int32_t x, y;
+    int32_t dx, dy;
+};
+
+// Flock metrics, used to compare simulation modes that can't match bit for bit
+struct FlockStats {
+    float polarization;         // Length of the mean heading, 1 when all fly the same way
+    float meanSpeed;
+    float meanNeighborDistance; // Mean distance to the nearest other boid
+};
+
+// Uniform grid structure (boids bucketed by cell with a stable counting sort, and their
+// positions and velocities copied out in cell order so neighbor scans stay in cache)
+struct SpatialGrid {
+    float cellSize = 1.0f;
+    int w = 0, h = 0;
+    std::vector<uint32_t> cellStart; // w * h + 1 offsets into the arrays below
+    std::vector<uint32_t> cursor;
+    std::vector<uint32_t> cellOf;
+    std::vector<uint32_t> indices;
+    std::vector<float> x, y, dx, dy;
+};
+
+// The fixed-point snapshot bucketed into grid cells the same way. Neighbor sums are
+// integers, so any visiting order gives the same result as brute force.
+struct FixedGrid {
+    int32_t cellSize = 1;
+    int w = 0, h = 0;
+    std::vector<uint32_t> cellStart; // w * h + 1 offsets into boids
+    std::vector<uint32_t> cursor;
+    std::vector<uint32_t> cellOf;
+    std::vector<FixedBoid> boids;
+};
+
+// Hardware counter totals, summed over every thread that has counters open
+struct PerfSample {
+    bool valid = false;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;  // Last-level cache misses
+    uint64_t branchMisses = 0;
+};
+
+// Hardware counters of one thread, opened as a group so they are read together
+struct PerfThreadCounters {
+    int leader = -1;
+    int fds[4] = {-1, -1, -1, -1};
+    int slots[4] = {-1, -1, -1, -1}; // Position of each counter in a group read, -1 if missing
+    int numOpen = 0;
+    ~PerfThreadCounters();
+};
+
+// Time spent in each phase of the last frame, in milliseconds, and the hardware
+// counters of the update and draw phases (when --perf is on)
+struct PhaseTimes {
+    double update = 0;
+    double predators = 0;
+    double draw = 0;
+    double checkpoint = 0; // Stall while the last checkpoint copied the state
+    PerfSample updateCounters;
+    PerfSample drawCounters;
+};
+
+// Trace event structure (a complete "X" event in the Chrome trace format)
+struct TraceEvent {
+    const char* name;
+    uint64_t start, end;  // Nanoseconds since tracing started
+    int64_t first, count; // Range of boids for worker tasks, -1 otherwise
+};
+
+// Trace buffer structure (one per thread and only ever written by that thread, so recording
+// needs no locks; it grows as events come in, and events past the capacity are dropped
+// until the next flush)
+struct TraceBuffer {
+    std::string threadName;
+    int threadId = 0;
+    std::vector<TraceEvent> events;
+    size_t dropped = 0;
+    bool retired = false; // Its thread has exited, so free it once its events are written
+};
+
+// Worker pool structure (persistent threads that split loops into chunks)
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::function<void(size_t, size_t, int)> job;
+    size_t jobCount = 0, chunkSize = 1;
+    std::atomic<size_t> nextChunk{0};
+    int generation = 0;
+    int running = 0;
+    bool quit = false;
+};
+
+// Largest world side fixed-point mode accepts. Positions are 16.16 in an int32, which
+// overflows at 32768 px; half that leaves room for boids flying past the edges.
+const int FIXED_MAX_WORLD_SIZE = 16384;
+
+// Simulation modes
+enum SimulationMode {
+    MODE_FLOAT, // Floating point, the reference
+    MODE_FIXED  // 16.16 fixed point, exact across compilers and machines built with -ffp-contract=off
+};
+
+// Neighbor search backends
+enum NeighborBackend {
+    BACKEND_BRUTE_FORCE, // Every boid checks every other boid
+    BACKEND_GRID         // Boids only check the 3x3 grid cells around them
+};
+
+// Random number streams, so draws for different purposes never share counters
+enum RandomStream : uint32_t {
+    STREAM_BOID_SPAWN,
+    STREAM_PREDATOR_SPAWN,
+    STREAM_PREDATOR_JITTER,
+    STREAM_WIND
+};
+
+// Constants
+const float VISUAL_RANGE = 75.0f;
+const float PREDATOR_FEAR_FACTOR = 0.15f; // Factor for boids to avoid predator
+const float OBSTACLE_RANGE = 40.0f; // Distance at which boids start steering away from obstacles
+const float OBSTACLE_AVOID_FACTOR = 1.0f; // Factor for boids to avoid obstacles
+const float WIND_CELL_SIZE = 40.0f; // Spacing of wind field nodes
+const float WIND_STRENGTH = 0.2f; // Strength of the steady, slowly rotating breeze
+const float WIND_TURBULENCE = 0.1f; // Strength of the curl noise gusts on top of it
+const int MAX_WIND_PARTICLES = 100;
+
+// Parameters of one world (controlled by sliders in the app, and boidsSetParam in the library)
+struct WorldParams {
+    int width = 1280;
+    int height = 720;
+    SimulationMode mode = MODE_FLOAT;
+    NeighborBackend backend = BACKEND_GRID;
+    float centeringFactor = 0.005f;
+    float avoidFactor = 0.05f;
+    float matchingFactor = 0.05f;
+    float margin = 120.0f;
+    float turnFactor = 0.3f;
+    float speedLimit = 7.5f;
+    float trailLength = 50.0f;
+};
+
+// World structure (everything one simulation reads and writes while stepping, so separate
+// worlds can step at the same time on different threads)
+struct World {
+    WorldParams params;
+    uint64_t seed = 0;  // Random numbers come from (seed, id, step, stream), nothing sequential
+    uint32_t step = 0;
+    uint32_t nextBoidId = 0;
+    uint32_t nextPredatorId = 0;
+    Flock boids;
+    Flock predators;
+    ObstacleField obstacles;      // Empty unless loaded
+    WindField wind;               // Applied while nudging boids
+    WindParticles windParticles;  // Show the wind
+    WorkerPool* workers = nullptr; // Threads that update the flock, or null to step on the calling thread
+
+    // Scratch rebuilt every step: the start-of-step copy of the flock (positions and
+    // velocities only), the neighbor grid built from it, and the fixed-point state while
+    // params.mode is MODE_FIXED
+    std::vector<Boid> boidSnapshot;
+    SpatialGrid grid;
+    std::vector<FixedBoid> fixedBoids;
+    std::vector<FixedBoid> fixedSnapshot;
+    FixedGrid fixedGrid;
+    std::vector<FixedBoid> fixedPredators;
+
+    PhaseTimes phaseTimes; // Phase timings of the last step
+};
+
+// Function prototypes
+void philox4x32(uint32_t key0, uint32_t key1, uint32_t counter[4]);
+void randomUniforms(const World& world, uint32_t id, RandomStream stream, float out[4]);
+void resizeFlock(Flock& flock, size_t count);
+void addToFlock(Flock& flock, uint32_t id, float x, float y, float dx, float dy);
+Boid loadBoid(const Flock& flock, size_t i);
+void storeBoid(Flock& flock, size_t i, const Boid& boid);
+Predator loadPredator(const Flock& flock, size_t i);
+void storePredator(Flock& flock, size_t i, const Predator& predator);
+size_t eraseIds(Flock& flock, const uint32_t* ids, size_t count);
+void setTrailCapacity(Flock& flock, size_t capacity);
+void clearTrails(Flock& flock);
+size_t trailPoint(const Flock& flock, size_t i, size_t k);
+void initBoids(World& world, size_t count);
+void addBoid(World& world, float x, float y);
+void addPredator(World& world, float x, float y);
+void initPredators(World& world, int count);
+void resetWorld(World& world);
+float distance(const Boid& b1, const Boid& b2);
+float distance(const Predator& p1, const Predator& p2);
+float distance(const Boid& boid, const Predator& predator);
+void flyTowardsCenter(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params);
+void avoidOthers(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params);
+void avoidPredator(Boid& boid, const Flock& predators);
+void matchVelocity(Boid& boid, const std::vector<Boid>& boids, const WorldParams& params);
+void limitSpeed(Boid& boid, const WorldParams& params);
+void keepWithinBounds(Boid& boid, const WorldParams& params);
+bool buildObstacleField(const std::vector<bool>& solid, int w, int h, const WorldParams& params, ObstacleField& field);
+void sampleObstacleField(const ObstacleField& field, float x, float y, float& dist, float& gradX, float& gradY);
+void avoidObstacles(Boid& boid, const ObstacleField& field);
+void updateTrail(Flock& flock, size_t i);
+void updateBoid(Boid& boid, const World& world);
+void updatePredator(World& world, size_t index);
+void startWorkers(WorkerPool& pool, int numThreads);
+void stopWorkers(WorkerPool& pool);
+void parallelFor(WorkerPool& pool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t, int)>& fn);
+WorkerPool& worldWorkers(World& world);
+void stepSimulation(World& world);
+void buildGrid(SpatialGrid& grid, const std::vector<Boid>& boids, float cellSize, int width, int height);
+void applyNeighborRulesGrid(Boid& boid, const SpatialGrid& grid, const Flock& predators,
+                            const WorldParams& params);
+void updateBoidGrid(Boid& boid, const World& world);
+uint64_t simulationChecksum(const Flock& boids, const Flock& predators);
+int32_t toFixed(float value);
+bool fixedPointFits(const WorldParams& params);
+void buildFixedGrid(FixedGrid& grid, const std::vector<FixedBoid>& boids, int32_t cellSize, int width, int height);
+void updateFixedBoids(World& world);
+void updateFixedPredators(World& world);
+FlockStats computeFlockStats(const Flock& boids);
+bool flockStatsAgree(const FlockStats& reference, const FlockStats& other);
+void updateWindField(WindField& field, const WorldParams& params, float dt);
+void sampleWindField(const WindField& field, float x, float y, float& vx, float& vy);
+void nudgeBoids(World& world, float dx, float dy);
+uint64_t traceBegin();
+void traceEnd(const char* name, uint64_t start, int64_t first = -1, int64_t count = -1);
+void setTraceThreadName(const std::string& name);
+bool writeTrace(const std::string& fileName);
+void openThreadPerfCounters();
+PerfSample readPerfCounters();
+PerfSample perfDelta(const PerfSample& before, const PerfSample& after);
+void addPerfSample(PerfSample& total, const PerfSample& delta);
+void printPerfSummary(const char* phase, const PerfSample& counters, double boidSteps);
+
+// Tracing (off unless --trace is given; when off every trace call is a single branch).
+// Shared by every world in the process.
+extern bool TRACING;
+
+// Hardware performance counters (off unless --perf is given or a benchmark runs), also
+// shared by every world
+extern bool PERF_COUNTERS;